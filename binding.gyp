@@ -6,8 +6,8 @@
      'target_name': 'BluetoothSerialPort',
      'conditions': [
         [ 'OS=="freebsd" or OS=="openbsd" or OS=="solaris" or (OS=="linux")', {
-          'sources': [ 'src/linux/BluetoothSerialPort.cc', 'src/linux/DeviceINQ.cc', 'src/linux/BTSerialPortBinding.cc' ],
-          'include_dirs' : [ "<!(node -e \"require('nan')\")", 'src' ],
+          'sources': [ 'src/linux/BluetoothSerialPort.cc', 'src/linux/DeviceINQ.cc', 'src/linux/BTSerialPortBinding.cc', 'src/linux/BluetoothHelpers.cc' ],
+          'include_dirs' : [ "<!(node -e \"require('nan')\")", 'src', 'src/linux' ],
           'libraries': ['-lbluetooth'],
           'cflags':['-std=c++11']
         }],
@@ -23,8 +23,8 @@
      'target_name': 'BluetoothSerialPortServer',
      'conditions': [
         [ 'OS=="freebsd" or OS=="openbsd" or OS=="solaris" or (OS=="linux")', {
-          'sources': [ 'src/linux/BluetoothSerialPortServer.cc', 'src/linux/BTSerialPortBindingServer.cc'],
-          'include_dirs' : [ "<!(node -e \"require('nan')\")", 'src' ],
+          'sources': [ 'src/linux/BluetoothSerialPortServer.cc', 'src/linux/BTSerialPortBindingServer.cc', 'src/linux/BluetoothHelpers.cc' ],
+          'include_dirs' : [ "<!(node -e \"require('nan')\")", 'src', 'src/linux' ],
           'libraries': ['-lbluetooth'],
           'cflags':['-std=gnu++0x']
         }],
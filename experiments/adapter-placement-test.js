@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Runs the adapter placement policy against simulated adapters. Connections
+// with a random data rate arrive and leave; every new connection is placed
+// with chooseAdapter() and the per adapter load is printed next to what the
+// kernel does without a bound adapter (everything on hci0).
+//
+// usage: node experiments/adapter-placement-test.js [adapters] [connections]
+
+(function() {
+    "use strict";
+
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var count = parseInt(process.argv[2], 10) || 3,
+        connections = parseInt(process.argv[3], 10) || 100;
+
+    function simulate(place) {
+        var adapters = [], live = [], rejected = 0;
+        for (var i = 0; i < count; i++) {
+            adapters.push({ links: 0, throughput: 0 });
+        }
+
+        for (var n = 0; n < connections; n++) {
+            // every other step one of the live connections goes away
+            if (n % 2 === 1 && live.length > 0) {
+                var gone = live.splice(Math.floor(Math.random() * live.length), 1)[0];
+                adapters[gone.adapter].links--;
+                adapters[gone.adapter].throughput -= gone.rate;
+            }
+
+            var index = place(adapters);
+            if (index < 0 || adapters[index].links >= 7) {
+                rejected++;
+                continue;
+            }
+
+            // mostly idle sensors and the occasional bulk transfer
+            var rate = Math.random() < 0.9 ? 500 : 60000;
+            adapters[index].links++;
+            adapters[index].throughput += rate;
+            live.push({ adapter: index, rate: rate });
+        }
+
+        return adapters.map(function(adapter) {
+            return adapter.links + ' links ' + Math.round(adapter.throughput / 1000) + ' KB/s';
+        }).join(', ') + ', ' + rejected + ' rejected';
+    }
+
+    console.log(count + ' adapters, ' + connections + ' connections');
+    console.log('first adapter: ' + simulate(function() { return 0; }));
+    console.log('auto:          ' + simulate(bt.chooseAdapter));
+})();
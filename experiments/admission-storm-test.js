@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Lets a crowd of clients hit a multi-client server at once, the way
+// handhelds do after a power cut, and prints what admission control let
+// through. A unix socket stands in for RFCOMM. It has no Bluetooth
+// addresses, so the allow and deny filters are not exercised here.
+//
+// usage: node experiments/admission-storm-test.js [clients] [maxClients] [acceptRate]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var clients = parseInt(process.argv[2], 10) || 300,
+        maxClients = parseInt(process.argv[3], 10) || 20,
+        acceptRate = parseFloat(process.argv[4]) || 50,
+        socketPath = path.join(os.tmpdir(), 'btsp-storm-' + process.pid + '.sock'),
+        connections = 0,
+        rejected = 0;
+
+    var server = new bt.BluetoothSerialPortServer();
+
+    server.on('connection', function() {
+        connections++;
+    });
+
+    server.listen(function() {}, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, { path: socketPath, backlog: 128, maxClients: maxClients, acceptRate: acceptRate });
+
+    function done() {
+        var stats = server.getStats();
+        console.log(clients + ' clients, ' + connections + ' reached javascript, ' +
+                    rejected + ' were closed by the server');
+        console.log(JSON.stringify(stats));
+        server.close();
+        fs.unlinkSync(socketPath);
+    }
+
+    setTimeout(function() {
+        for (var i = 0; i < clients; i++) {
+            var socket = net.connect(socketPath);
+            socket.on('error', function() {});
+            socket.on('close', function() {
+                rejected++;
+            });
+            socket.resume();
+        }
+
+        // the admitted clients stay connected, give the rest time to be turned away
+        setTimeout(done, 1000);
+    }, 100);
+})();
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Sends the same blob to many clients of a multi-client server, once with a
+// write() per connection and once with broadcast(). A unix socket stands in
+// for RFCOMM so no hardware is needed.
+//
+// usage: node experiments/broadcast-bench.js [clients] [rounds] [blob KB]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var clients = parseInt(process.argv[2], 10) || 50,
+        rounds = parseInt(process.argv[3], 10) || 100,
+        blob = Buffer.alloc((parseInt(process.argv[4], 10) || 4) * 1024, 0x42),
+        socketPath = path.join(os.tmpdir(), 'btsp-broadcast-' + process.pid + '.sock'),
+        sockets = [];
+
+    var server = new bt.BluetoothSerialPortServer();
+
+    function perConnection(done) {
+        var pending = rounds * server.connections.length;
+        for (var r = 0; r < rounds; r++) {
+            server.connections.forEach(function(connection) {
+                connection.write(blob, function() {
+                    if (--pending === 0) done();
+                });
+            });
+        }
+    }
+
+    function broadcast(done) {
+        var pending = rounds;
+        for (var r = 0; r < rounds; r++) {
+            server.broadcast(blob, { policy: 'queue' }, function() {
+                if (--pending === 0) done();
+            });
+        }
+    }
+
+    function run(name, fn, next) {
+        var start = process.hrtime(),
+            cpu = process.cpuUsage();
+
+        fn(function() {
+            var time = process.hrtime(start),
+                used = process.cpuUsage(cpu);
+            console.log(name + ': ' + (time[0] * 1e3 + time[1] / 1e6).toFixed(0) + ' ms, ' +
+                        ((used.user + used.system) / 1000).toFixed(0) + ' ms CPU');
+            next();
+        });
+    }
+
+    server.listen(function() {}, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, { path: socketPath, backlog: clients });
+
+    server.on('connection', function() {
+        if (server.connections.length < clients) {
+            return;
+        }
+
+        console.log(clients + ' clients, ' + rounds + ' rounds of ' + blob.length + ' bytes');
+        run('write per connection', perConnection, function() {
+            run('broadcast', broadcast, function() {
+                sockets.forEach(function(socket) { socket.destroy(); });
+                server.close();
+                fs.unlinkSync(socketPath);
+            });
+        });
+    });
+
+    setTimeout(function() {
+        for (var i = 0; i < clients; i++) {
+            var socket = net.connect(socketPath);
+            socket.resume(); // drain
+            sockets.push(socket);
+        }
+    }, 100);
+})();
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Connects and disconnects clients of a single-client server as fast as it
+// will go. Each client is dropped with disconnectClient() called twice, so
+// two wake-ups arrive before the reader runs. A cycle only counts when the
+// server reports 'disconnected' once and accepts the next client. The
+// descriptor count must not grow. A unix socket stands in for RFCOMM.
+//
+// usage: node experiments/control-churn-test.js [cycles]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var cycles = parseInt(process.argv[2], 10) || 1000,
+        socketPath = path.join(os.tmpdir(), 'btsp-churn-' + process.pid + '.sock'),
+        disconnects = 0,
+        fdsBefore,
+        start;
+
+    function openFds() {
+        return fs.readdirSync('/proc/self/fd').length;
+    }
+
+    var server = new bt.BluetoothSerialPortServer();
+
+    server.on('data', function() {
+        server.disconnectClient();
+        server.disconnectClient();
+    });
+
+    server.on('disconnected', function() {
+        disconnects++;
+    });
+
+    function cycle(remaining) {
+        if (remaining === 0) {
+            var time = process.hrtime(start);
+            console.log(cycles + ' cycles in ' + (time[0] * 1e3 + time[1] / 1e6).toFixed(0) + ' ms, ' +
+                        disconnects + ' disconnects, descriptors ' + fdsBefore + ' -> ' + openFds());
+            server.close();
+            fs.unlinkSync(socketPath);
+            return;
+        }
+
+        var socket = net.connect(socketPath, function() {
+            socket.write('x');
+        });
+        socket.resume();
+        socket.on('close', function() {
+            cycle(remaining - 1);
+        });
+    }
+
+    server.listen(function() {}, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, { path: socketPath });
+
+    setTimeout(function() {
+        fdsBefore = openFds();
+        start = process.hrtime();
+        cycle(cycles);
+    }, 100);
+})();
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Runs parseEir against Extended Inquiry Responses captured from devices,
+// each zero padded to the 240 bytes a controller hands over, and checks
+// what comes out.
+//
+// usage: node experiments/eir-parse-test.js
+
+(function() {
+    "use strict";
+
+    var assert = require('assert');
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var SPP = '00001101-0000-1000-8000-00805f9b34fb';
+
+    var captures = [{
+        what: 'phone: complete name, TX power and 16 bit UUIDs',
+        eir: '0b0947616c61787920533231020af8070301110a111f11',
+        expected: {
+            name: 'Galaxy S21', nameComplete: true, txPower: -8,
+            uuids: [SPP, '0000110a-0000-1000-8000-00805f9b34fb', '0000111f-0000-1000-8000-00805f9b34fb']
+        }
+    }, {
+        what: 'serial module: shortened name and a 128 bit UUID',
+        eir: '050848432d301107fb349b5f800000800010000001110000',
+        expected: { name: 'HC-0', nameComplete: false, uuids: [SPP] }
+    }, {
+        what: 'no name, a 32 bit UUID',
+        eir: '050501110000',
+        expected: { uuids: [SPP] }
+    }, {
+        what: 'name field running past the end',
+        eir: '020a042009437574',
+        expected: { txPower: 4, uuids: [] }
+    }, {
+        what: 'shortened name before the complete one',
+        eir: '04085370650809537065616b6572020a00',
+        expected: { name: 'Speaker', nameComplete: true, txPower: 0, uuids: [] }
+    }, {
+        what: 'empty response',
+        eir: '',
+        expected: { uuids: [] }
+    }];
+
+    captures.forEach(function(capture) {
+        var buffer = Buffer.alloc(240);
+        Buffer.from(capture.eir, 'hex').copy(buffer);
+
+        assert.deepStrictEqual(bt.parseEir(buffer), capture.expected, capture.what);
+        console.log('ok ' + capture.what);
+    });
+
+    // a response cut short by the caller is not read past its end
+    assert.deepStrictEqual(bt.parseEir(Buffer.from('0b0947616c617879', 'hex')), { uuids: [] });
+    console.log('ok truncated buffer');
+})();
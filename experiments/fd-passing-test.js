@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Hands a live connection from one BluetoothSerialPort to another over a unix
+// socket with SCM_RIGHTS, the way a broker passes connections to worker
+// processes. A socket pair stands in for the RFCOMM connection so no
+// Bluetooth hardware is needed.
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var link = bt.socketPair();     // stands in for the RFCOMM connection
+    var channel = bt.socketPair();  // the unix socket between broker and worker
+    var received = '';
+
+    var remote = new net.Socket({ fd: link[1], readable: true, writable: true });
+    remote.on('data', function(buffer) {
+        received += buffer;
+        console.log('Remote received: ' + buffer);
+
+        if (received === 'before detach|after adopt') {
+            remote.write('pong');
+        }
+    });
+
+    var broker = bt.BluetoothSerialPort.fromFd(link[0]);
+    broker.write(Buffer.from('before detach|'), function(err) {
+        if (err) throw err;
+
+        var fd = broker.detach();
+        bt.sendFd(channel[0], fd);
+        fs.closeSync(fd);
+        console.log('Broker handed over fd ' + fd);
+    });
+
+    bt.receiveFd(channel[1], function(err, fd) {
+        if (err) throw err;
+        console.log('Worker adopted fd ' + fd);
+
+        var worker = bt.BluetoothSerialPort.fromFd(fd);
+        worker.on('data', function(buffer) {
+            console.log('Worker received: ' + buffer);
+            worker.close();
+            remote.destroy();
+            fs.closeSync(channel[0]);
+            fs.closeSync(channel[1]);
+        });
+
+        worker.write(Buffer.from('after adopt'), function(err) {
+            if (err) throw err;
+        });
+    });
+})();
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Measures the CPU time an idle server uses while it waits for a client. A
+// unix socket stands in for RFCOMM so no hardware is needed.
+//
+// usage: node experiments/idle-server-cpu.js [seconds]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var seconds = parseInt(process.argv[2], 10) || 5,
+        socketPath = path.join(os.tmpdir(), 'btsp-idle-' + process.pid + '.sock');
+
+    var server = new bt.BluetoothSerialPortServer();
+    server.listen(function() {}, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, { path: socketPath });
+
+    var before = process.cpuUsage();
+    setTimeout(function() {
+        var used = process.cpuUsage(before);
+        console.log('idle for ' + seconds + ' s: ' +
+                    ((used.user + used.system) / 1000).toFixed(1) + ' ms CPU');
+        server.close();
+        fs.unlinkSync(socketPath);
+    }, seconds * 1000);
+})();
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Half of the clients of a multi-client server answer keepalive probes and
+// half stay silent. The silent ones should be dropped after idleTimeout and
+// the others kept. Afterwards a single-client server (no backlog) gets one
+// silent client, which should end with a 'timeout' event as well. A unix
+// socket stands in for RFCOMM.
+//
+// usage: node experiments/idle-timeout-test.js [clients] [idleTimeout ms]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var clients = parseInt(process.argv[2], 10) || 100,
+        idleTimeout = parseInt(process.argv[3], 10) || 1000,
+        socketPath = path.join(os.tmpdir(), 'btsp-idle-' + process.pid + '.sock'),
+        timeouts = 0,
+        start,
+        sockets = [];
+
+    var server = new bt.BluetoothSerialPortServer();
+
+    server.on('timeout', function() {
+        if (timeouts++ === 0) {
+            var time = process.hrtime(start);
+            console.log('first timeout after ' + (time[0] * 1e3 + time[1] / 1e6).toFixed(0) + ' ms');
+        }
+    });
+
+    server.listen(function() {}, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, {
+        path: socketPath,
+        backlog: clients,
+        idleTimeout: idleTimeout,
+        keepaliveInterval: idleTimeout / 3,
+        keepaliveData: 'ping'
+    });
+
+    setTimeout(function() {
+        start = process.hrtime();
+        for (var i = 0; i < clients; i++) {
+            var socket = net.connect(socketPath),
+                responsive = (i % 2 === 0);
+
+            socket.on('data', responsive ? function() { this.write('pong'); } : function() {});
+            socket.on('error', function() {});
+            sockets.push(socket);
+        }
+
+        setTimeout(function() {
+            console.log(clients + ' clients, ' + timeouts + ' timed out, ' +
+                        server.connections.length + ' still connected');
+            sockets.forEach(function(socket) { socket.destroy(); });
+            server.close();
+            fs.unlinkSync(socketPath);
+            singleClient();
+        }, idleTimeout * 3);
+    }, 100);
+
+    function singleClient() {
+        var single = new bt.BluetoothSerialPortServer(),
+            timedOut = false,
+            socket;
+
+        single.on('timeout', function() { timedOut = true; });
+        single.on('failure', function(err) { console.log('single client failure: ' + err); });
+
+        single.listen(function() {}, function(err) {
+            console.log('Listen failed: ' + err);
+            process.exit(1);
+        }, {
+            path: socketPath,
+            idleTimeout: idleTimeout
+        });
+
+        setTimeout(function() {
+            socket = net.connect(socketPath);
+            socket.on('error', function() {});
+
+            setTimeout(function() {
+                console.log('single client ' + (timedOut ? 'timed out' : 'did NOT time out'));
+                socket.destroy();
+                single.close();
+                fs.unlinkSync(socketPath);
+                process.exitCode = timedOut ? 0 : 1;
+            }, idleTimeout * 3);
+        }, 100);
+    }
+})();
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Cancels an inquiry against a fake controller on the other end of a socket
+// pair. The controller starts the inquiry, reports a device without a name
+// and never answers the name request nor ends the inquiry. The inquiry is
+// cancelled as soon as the name request comes in. Checks the controller gets
+// the Inquiry Cancel and the Remote Name Request Cancel commands, that
+// 'cancelled' is emitted instead of 'finished' and prints how long it took.
+// A second inquiry on the same object must then run normally.
+//
+// usage: node experiments/inquiry-cancel-test.js
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var OPCODE_INQUIRY = 0x0401,
+        OPCODE_INQUIRY_CANCEL = 0x0402,
+        OPCODE_REMOTE_NAME_REQ = 0x0419,
+        OPCODE_REMOTE_NAME_REQ_CANCEL = 0x041a;
+
+    var EVT_INQUIRY_COMPLETE = 0x01,
+        EVT_INQUIRY_RESULT = 0x02,
+        EVT_REMOTE_NAME_REQ_COMPLETE = 0x07,
+        EVT_CMD_COMPLETE = 0x0e,
+        EVT_CMD_STATUS = 0x0f;
+
+    var ADDRESS = '00:11:22:33:44:01';
+
+    function event(code, params) {
+        return Buffer.concat([Buffer.from([0x04, code, params.length]), params]);
+    }
+
+    function cmdStatus(status, opcode) {
+        return event(EVT_CMD_STATUS, Buffer.from([status, 1, opcode & 0xff, opcode >> 8]));
+    }
+
+    function cmdComplete(opcode) {
+        return event(EVT_CMD_COMPLETE, Buffer.from([1, opcode & 0xff, opcode >> 8, 0]));
+    }
+
+    // bdaddr_t is little endian, then pscan_rep_mode, pscan_period_mode,
+    // pscan_mode, dev_class, clock_offset
+    var result = event(EVT_INQUIRY_RESULT, Buffer.concat([Buffer.from([1]),
+        Buffer.from(ADDRESS.split(':').reverse().map(function(b) { return parseInt(b, 16); })),
+        Buffer.from([1, 0, 0, 0x0c, 0x02, 0x5a, 0x34, 0x12])]));
+
+    var pair = bt.socketPair('seqpacket'),
+        hci = pair[0],
+        controller = pair[1],
+        answer = false,
+        seen = {},
+        failed = false;
+
+    function send(packet, delay) {
+        setTimeout(function() {
+            fs.writeSync(controller, packet);
+        }, delay || 0);
+    }
+
+    // only answers when `answer` is set, otherwise the inquiry and the name
+    // request hang until they are cancelled
+    function command(packet) {
+        if (packet[0] !== 0x01 || packet.length < 4) {
+            return;
+        }
+        var opcode = packet.readUInt16LE(1);
+        seen[opcode] = (seen[opcode] || 0) + 1;
+
+        if (opcode === OPCODE_INQUIRY) {
+            send(cmdStatus(0, opcode));
+            send(result, 100);
+            if (answer) {
+                send(event(EVT_INQUIRY_COMPLETE, Buffer.from([0])), 300);
+            }
+        } else if (opcode === OPCODE_REMOTE_NAME_REQ) {
+            send(cmdStatus(0, opcode));
+            if (answer) {
+                var field = Buffer.alloc(248);
+                field.write('Answered');
+                send(event(EVT_REMOTE_NAME_REQ_COMPLETE, Buffer.concat([Buffer.from([0]), packet.slice(4, 10), field])), 50);
+            } else {
+                cancelNow();
+            }
+        } else if (opcode === OPCODE_INQUIRY_CANCEL) {
+            send(cmdComplete(opcode));
+        } else if (opcode === OPCODE_REMOTE_NAME_REQ_CANCEL) {
+            send(cmdStatus(0, opcode));
+        }
+    }
+
+    function receive() {
+        var buffer = Buffer.alloc(260);
+        fs.read(controller, buffer, 0, buffer.length, null, function(err, length) {
+            if (err || length === 0) {
+                fs.closeSync(controller);
+                return;
+            }
+            command(buffer.slice(0, length));
+            receive();
+        });
+    }
+    receive();
+
+    var serial = new bt.BluetoothSerialPort(),
+        handle,
+        cancelledAt = null;
+
+    function cancelNow() {
+        cancelledAt = process.hrtime();
+        handle.cancel();
+        // a second cancel is ignored
+        handle.cancel();
+    }
+
+    serial.once('found', function(address, name) {
+        console.log('found before the cancel: ' + address + ' ' + name);
+        failed = true;
+    });
+
+    serial.once('finished', function() {
+        console.log('finished instead of cancelled');
+        failed = true;
+    });
+
+    serial.once('cancelled', function() {
+        var time = process.hrtime(cancelledAt);
+        console.log('cancelled after ' + (time[0] * 1e3 + time[1] / 1e6).toFixed(1) + ' ms');
+        if (!seen[OPCODE_INQUIRY_CANCEL]) {
+            console.log('no Inquiry Cancel sent');
+            failed = true;
+        }
+        if (!seen[OPCODE_REMOTE_NAME_REQ_CANCEL]) {
+            console.log('no Remote Name Request Cancel sent');
+            failed = true;
+        }
+        serial.removeAllListeners();
+
+        // the object is free for the next inquiry
+        answer = true;
+        serial.once('found', function(address, name) {
+            if (name !== 'Answered') {
+                console.log('wrong name after the cancel: ' + name);
+                failed = true;
+            }
+        });
+        serial.once('finished', function() {
+            fs.closeSync(hci);
+            console.log(failed ? 'FAILED' : 'OK');
+            process.exitCode = failed ? 1 : 0;
+        });
+        serial.inquire({ hciSocket: hci });
+    });
+
+    handle = serial.inquire({ hciSocket: hci });
+})();
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Measures how long an inquiry takes, and how many devices it finds, for a
+// few inquiry configurations against a simulated controller. The
+// controller answers like a radio would: each device answers once at its
+// own point into the inquiry, most within the first 2.5 seconds, and only
+// devices in limited discoverable mode answer the LIAC. The controller
+// ends the inquiry after `length` or after `maxResponses` answers. Half the
+// devices send their name in the Extended Inquiry Response, the others are
+// asked for it. Times are scaled by `scale` to keep the run short.
+// flushCache: false is not covered, it asks the kernel of a real adapter.
+//
+// usage: node experiments/inquiry-config-bench.js [devices] [scale]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var count = parseInt(process.argv[2], 10) || 12,
+        scale = parseFloat(process.argv[3]) || 0.25;
+
+    var OPCODE_INQUIRY = 0x0401,
+        OPCODE_REMOTE_NAME_REQ = 0x0419;
+
+    var EVT_INQUIRY_COMPLETE = 0x01,
+        EVT_REMOTE_NAME_REQ_COMPLETE = 0x07,
+        EVT_CMD_STATUS = 0x0f,
+        EVT_EXTENDED_INQUIRY_RESULT = 0x2f;
+
+    var GIAC = 0x9e8b33,
+        LIAC = 0x9e8b00;
+
+    // the same population every run
+    var seed = 42;
+    function random() {
+        seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+        return seed / 0x7fffffff;
+    }
+
+    var population = [];
+    for (var i = 0; i < count; i++) {
+        population.push({
+            address: '00:11:22:33:55:' + ('0' + i.toString(16)).slice(-2).toUpperCase(),
+            name: 'Device ' + i,
+            answersAt: -Math.log(1 - random() * 0.98) * 1000, // ms, mean one second
+            limited: random() < 0.25,
+            eirName: i % 2 === 0
+        });
+    }
+
+    function bdaddr(address) {
+        return Buffer.from(address.split(':').reverse().map(function(b) { return parseInt(b, 16); }));
+    }
+
+    function event(code, params) {
+        return Buffer.concat([Buffer.from([0x04, code, params.length]), params]);
+    }
+
+    function cmdStatus(opcode) {
+        return event(EVT_CMD_STATUS, Buffer.from([0, 1, opcode & 0xff, opcode >> 8]));
+    }
+
+    function extendedInquiryResult(device) {
+        var eir = Buffer.alloc(240);
+        if (device.eirName) {
+            eir[0] = Buffer.byteLength(device.name) + 1;
+            eir[1] = 0x09;
+            eir.write(device.name, 2);
+        }
+        return event(EVT_EXTENDED_INQUIRY_RESULT, Buffer.concat([Buffer.from([1]), bdaddr(device.address),
+            Buffer.from([1, 0, 0x0c, 0x02, 0x5a, 0x34, 0x12, 0xc4]), eir]));
+    }
+
+    function remoteNameComplete(address, name) {
+        var field = Buffer.alloc(248);
+        field.write(name);
+        return event(EVT_REMOTE_NAME_REQ_COMPLETE, Buffer.concat([Buffer.from([0]), bdaddr(address), field]));
+    }
+
+    function run(options, done) {
+        var pair = bt.socketPair('seqpacket'),
+            hci = pair[0],
+            controller = pair[1],
+            timers = [],
+            complete = false;
+
+        function finishInquiry() {
+            if (!complete) {
+                complete = true;
+                timers.forEach(clearTimeout);
+                fs.writeSync(controller, event(EVT_INQUIRY_COMPLETE, Buffer.from([0])));
+            }
+        }
+
+        function command(packet) {
+            var opcode = packet.readUInt16LE(1);
+
+            if (opcode === OPCODE_INQUIRY) {
+                var lap = packet[4] | (packet[5] << 8) | (packet[6] << 16),
+                    length = packet[7] * 1280,
+                    maxResponses = packet[8],
+                    answered = 0;
+
+                fs.writeSync(controller, cmdStatus(opcode));
+                population.forEach(function(device) {
+                    if (device.answersAt >= length || (lap === LIAC && !device.limited) || (lap !== LIAC && lap !== GIAC)) {
+                        return;
+                    }
+                    timers.push(setTimeout(function() {
+                        fs.writeSync(controller, extendedInquiryResult(device));
+                        if (maxResponses && ++answered === maxResponses) {
+                            finishInquiry();
+                        }
+                    }, device.answersAt * scale));
+                });
+                timers.push(setTimeout(finishInquiry, length * scale));
+            } else if (opcode === OPCODE_REMOTE_NAME_REQ) {
+                var address = Array.prototype.slice.call(packet.slice(4, 10)).reverse().map(function(b) {
+                    return ('0' + b.toString(16)).slice(-2);
+                }).join(':').toUpperCase();
+                var device = population.filter(function(d) { return d.address === address; })[0];
+                fs.writeSync(controller, cmdStatus(opcode));
+                // paging a device takes a while
+                setTimeout(function() {
+                    fs.writeSync(controller, remoteNameComplete(address, device.name));
+                }, 300 * scale);
+            }
+        }
+
+        function receive() {
+            var buffer = Buffer.alloc(260);
+            fs.read(controller, buffer, 0, buffer.length, null, function(err, length) {
+                if (err || length === 0) {
+                    fs.closeSync(controller);
+                    return;
+                }
+                if (buffer[0] === 0x01 && length >= 4) {
+                    command(buffer.slice(0, length));
+                }
+                receive();
+            });
+        }
+        receive();
+
+        var serial = new bt.BluetoothSerialPort(),
+            start = process.hrtime(),
+            found = 0;
+
+        serial.on('found', function() {
+            found++;
+        });
+        serial.on('finished', function() {
+            var time = process.hrtime(start);
+            fs.closeSync(hci);
+            done((time[0] * 1e3 + time[1] / 1e6) / scale, found);
+        });
+
+        options.hciSocket = hci;
+        serial.inquire(options);
+    }
+
+    var configurations = [
+        { length: 8 },
+        { length: 3 },
+        { length: 2 },
+        { length: 8, maxResponses: Math.ceil(count / 2) },
+        { length: 3, lap: 'liac' }
+    ];
+
+    var reachable = population.length,
+        limited = population.filter(function(d) { return d.limited; }).length;
+    console.log(count + ' devices, ' + limited + ' in limited discoverable mode, times in simulated ms');
+
+    (function next(i) {
+        if (i === configurations.length) {
+            return;
+        }
+        var options = configurations[i],
+            label = JSON.stringify(options);
+        run(options, function(duration, found) {
+            var of = options.lap === 'liac' ? limited : reachable;
+            console.log('  ' + label + ': ' + duration.toFixed(0) + ' ms, ' + found + ' of ' + of + ' found');
+            next(i + 1);
+        });
+    })(0);
+})();
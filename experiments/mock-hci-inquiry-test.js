@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Runs an inquiry against a fake controller on the other end of a socket
+// pair. The controller answers the commands with recorded HCI event bytes:
+// three devices coming in over the plain, RSSI and extended inquiry result
+// events, one of them reported twice, and the remote name request results
+// for the two that do not send their name in an Extended Inquiry Response.
+// Checks every device is found once with its name and prints how long the
+// first one took. With `strict` the controller refuses name requests while
+// it inquires, as some adapters do. With `cache` the inquiry keeps a device
+// cache file and is run again in a new process, which should take all
+// names from the file and ask the controller for none.
+//
+// usage: node experiments/mock-hci-inquiry-test.js [strict | cache]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var os = require('os');
+    var path = require('path');
+    var childProcess = require('child_process');
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var mode = process.argv[2],
+        strict = mode === 'strict',
+        cacheFile = process.argv[3] || path.join(os.tmpdir(), 'mock-hci-inquiry-' + process.pid + '.cache');
+
+    var OPCODE_INQUIRY = 0x0401,
+        OPCODE_REMOTE_NAME_REQ = 0x0419,
+        OPCODE_REMOTE_NAME_REQ_CANCEL = 0x041a;
+
+    var EVT_INQUIRY_COMPLETE = 0x01,
+        EVT_INQUIRY_RESULT = 0x02,
+        EVT_REMOTE_NAME_REQ_COMPLETE = 0x07,
+        EVT_CMD_STATUS = 0x0f,
+        EVT_INQUIRY_RESULT_WITH_RSSI = 0x22,
+        EVT_EXTENDED_INQUIRY_RESULT = 0x2f;
+
+    var HCI_COMMAND_DISALLOWED = 0x0c;
+
+    var devices = {
+        '00:11:22:33:44:01': 'Plain result',
+        '00:11:22:33:44:02': 'RSSI result',
+        '00:11:22:33:44:03': 'Extended result'
+    };
+
+    // bdaddr_t is little endian
+    function bdaddr(address) {
+        return Buffer.from(address.split(':').reverse().map(function(b) { return parseInt(b, 16); }));
+    }
+
+    function event(code, params) {
+        return Buffer.concat([Buffer.from([0x04, code, params.length]), params]);
+    }
+
+    function cmdStatus(status, opcode) {
+        return event(EVT_CMD_STATUS, Buffer.from([status, 1, opcode & 0xff, opcode >> 8]));
+    }
+
+    // pscan_rep_mode, pscan_period_mode, pscan_mode, dev_class, clock_offset
+    function inquiryResult(address) {
+        return event(EVT_INQUIRY_RESULT, Buffer.concat([Buffer.from([1]), bdaddr(address),
+            Buffer.from([1, 0, 0, 0x0c, 0x02, 0x5a, 0x34, 0x12])]));
+    }
+
+    // pscan_rep_mode, pscan_period_mode, dev_class, clock_offset, rssi
+    function inquiryResultWithRssi(address) {
+        return event(EVT_INQUIRY_RESULT_WITH_RSSI, Buffer.concat([Buffer.from([1]), bdaddr(address),
+            Buffer.from([1, 0, 0x0c, 0x02, 0x5a, 0x34, 0x12, 0xc4])]));
+    }
+
+    // the response carries the complete name, so no name request follows
+    function extendedInquiryResult(address, name) {
+        var eir = Buffer.alloc(240);
+        eir[0] = Buffer.byteLength(name) + 1;
+        eir[1] = 0x09;
+        eir.write(name, 2);
+        return event(EVT_EXTENDED_INQUIRY_RESULT, Buffer.concat([Buffer.from([1]), bdaddr(address),
+            Buffer.from([1, 0, 0x0c, 0x02, 0x5a, 0x34, 0x12, 0xc4]), eir]));
+    }
+
+    function remoteNameComplete(address, name) {
+        var field = Buffer.alloc(248);
+        field.write(name);
+        return event(EVT_REMOTE_NAME_REQ_COMPLETE, Buffer.concat([Buffer.from([0]), bdaddr(address), field]));
+    }
+
+    function scan(options, done) {
+        var pair = bt.socketPair('seqpacket'),
+            hci = pair[0],
+            controller = pair[1],
+            inquiring = false,
+            nameRequests = {};
+
+        function send(packet, delay) {
+            setTimeout(function() {
+                fs.writeSync(controller, packet);
+            }, delay || 0);
+        }
+
+        function command(packet) {
+            if (packet[0] !== 0x01 || packet.length < 4) {
+                return;
+            }
+            var opcode = packet.readUInt16LE(1);
+
+            if (opcode === OPCODE_INQUIRY) {
+                inquiring = true;
+                send(cmdStatus(0, opcode));
+                send(inquiryResult('00:11:22:33:44:01'), 150);
+                send(inquiryResultWithRssi('00:11:22:33:44:02'), 300);
+                send(inquiryResult('00:11:22:33:44:01'), 400);
+                send(extendedInquiryResult('00:11:22:33:44:03', devices['00:11:22:33:44:03']), 500);
+                setTimeout(function() {
+                    inquiring = false;
+                    fs.writeSync(controller, event(EVT_INQUIRY_COMPLETE, Buffer.from([0])));
+                }, 1500);
+            } else if (opcode === OPCODE_REMOTE_NAME_REQ) {
+                if (strict && inquiring) {
+                    send(cmdStatus(HCI_COMMAND_DISALLOWED, opcode));
+                    return;
+                }
+                var address = Array.prototype.slice.call(packet.slice(4, 10)).reverse().map(function(b) {
+                    return ('0' + b.toString(16)).slice(-2);
+                }).join(':').toUpperCase();
+                nameRequests[address] = (nameRequests[address] || 0) + 1;
+                send(cmdStatus(0, opcode));
+                send(remoteNameComplete(address, devices[address]), 100);
+            } else if (opcode === OPCODE_REMOTE_NAME_REQ_CANCEL) {
+                send(cmdStatus(0, opcode));
+            }
+        }
+
+        function receive() {
+            var buffer = Buffer.alloc(260);
+            fs.read(controller, buffer, 0, buffer.length, null, function(err, length) {
+                if (err || length === 0) {
+                    fs.closeSync(controller);
+                    return;
+                }
+                command(buffer.slice(0, length));
+                receive();
+            });
+        }
+        receive();
+
+        var serial = new bt.BluetoothSerialPort(),
+            start = process.hrtime(),
+            first = null,
+            seen = {},
+            failed = false;
+
+        function elapsed() {
+            var time = process.hrtime(start);
+            return time[0] * 1e3 + time[1] / 1e6;
+        }
+
+        serial.on('found', function(address, name) {
+            if (first === null) {
+                first = elapsed();
+            }
+            console.log('  ' + elapsed().toFixed(0) + ' ms ' + address + ' ' + name);
+            if (seen[address]) {
+                console.log('found twice: ' + address);
+                failed = true;
+            }
+            seen[address] = true;
+            if (devices[address] !== name) {
+                console.log('wrong name for ' + address + ': ' + name);
+                failed = true;
+            }
+        });
+
+        serial.on('finished', function() {
+            fs.closeSync(hci);
+            Object.keys(devices).forEach(function(address) {
+                if (!seen[address]) {
+                    console.log('not found: ' + address);
+                    failed = true;
+                }
+            });
+            if (nameRequests['00:11:22:33:44:03']) {
+                console.log('name asked for although the response carried it');
+                failed = true;
+            }
+            console.log('first device after ' + (first === null ? '-' : first.toFixed(0) + ' ms') +
+                        ', done after ' + elapsed().toFixed(0) + ' ms, ' +
+                        Object.keys(nameRequests).length + ' names asked for');
+            done(failed, nameRequests);
+        });
+
+        options.hciSocket = hci;
+        serial.inquire(options);
+    }
+
+    function report(failed) {
+        console.log(failed ? 'FAILED' : 'OK');
+        process.exitCode = failed ? 1 : 0;
+    }
+
+    if (mode === 'cache-again') {
+        // the second run, with nothing but the file to go on
+        scan({ nameTimeout: 2000, cacheTtl: 60000, cacheFile: cacheFile }, function(failed, nameRequests) {
+            if (Object.keys(nameRequests).length > 0) {
+                console.log('names asked for although the cache had them');
+                failed = true;
+            }
+            report(failed);
+        });
+    } else if (mode === 'cache') {
+        scan({ nameTimeout: 2000, cacheTtl: 60000, cacheFile: cacheFile }, function(failed) {
+            var again = childProcess.fork(__filename, ['cache-again', cacheFile]);
+            again.on('exit', function(code) {
+                fs.unlinkSync(cacheFile);
+                report(failed || code !== 0);
+            });
+        });
+    } else {
+        scan({ nameTimeout: 2000 }, report);
+    }
+})();
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Frames per KB of the default write mode versus the `mtu` write mode over a
+// simulated MTU limited transport. Every write() is cut into frames of at
+// most `mtu` bytes, like the kernel does for an RFCOMM socket.
+//
+// usage: node experiments/mtu-write-bench.js [mtu] [writes]
+
+(function() {
+    "use strict";
+
+    var mtu = parseInt(process.argv[2], 10) || 127,
+        writes = parseInt(process.argv[3], 10) || 10000;
+
+    function framesFor(length) {
+        return Math.ceil(length / mtu);
+    }
+
+    // default mode: one write() per application buffer
+    function defaultMode(sizes) {
+        return sizes.reduce(function(frames, size) {
+            return frames + framesFor(size);
+        }, 0);
+    }
+
+    // mtu mode: whole frames per buffer, the tail is topped up with the
+    // buffers queued behind it. `depth` is how many writes are queued.
+    function mtuMode(sizes, depth) {
+        var frames = 0, pending = 0;
+
+        sizes.forEach(function(size, i) {
+            pending += size;
+            frames += Math.floor(pending / mtu);
+            pending %= mtu;
+
+            // the queue ran dry, the tail leaves as a short frame
+            if (pending > 0 && ((i + 1) % depth === 0 || i === sizes.length - 1)) {
+                frames++;
+                pending = 0;
+            }
+        });
+
+        return frames;
+    }
+
+    function workload(name, size) {
+        var sizes = [], bytes = 0;
+        for (var i = 0; i < writes; i++) {
+            sizes.push(size());
+            bytes += sizes[i];
+        }
+
+        var kb = bytes / 1024,
+            row = [name, (defaultMode(sizes) / kb).toFixed(2)];
+
+        [1, 4, 16].forEach(function(depth) {
+            row.push((mtuMode(sizes, depth) / kb).toFixed(2));
+        });
+
+        console.log(row.join('\t'));
+    }
+
+    console.log('frames per KB, mtu ' + mtu + ', ' + writes + ' writes');
+    console.log(['workload', 'default', 'mtu/q1', 'mtu/q4', 'mtu/q16'].join('\t'));
+
+    workload('1000B', function() { return 1000; });
+    workload('random', function() { return 1 + Math.floor(Math.random() * 1000); });
+    workload('20B', function() { return 20; });
+    workload('mixed', function() { return Math.random() < 0.8 ? 16 : 512; });
+})();
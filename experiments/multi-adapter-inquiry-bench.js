@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Compares an inquiry on the default adapter with one on all adapters at
+// once, on a host with several dongles and devices around. Prints for each
+// run how many devices were found, how long it took and which adapter heard
+// each device best. Devices only the run over all adapters found are
+// listed, they are the ones a single adapter missed.
+//
+// usage: node experiments/multi-adapter-inquiry-bench.js [length]
+
+(function() {
+    "use strict";
+
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var length = parseInt(process.argv[2], 10) || 4;
+
+    function run(label, options, done) {
+        var serial = new bt.BluetoothSerialPort(),
+            start = process.hrtime(),
+            first = null,
+            devices = {};
+
+        function elapsed() {
+            var time = process.hrtime(start);
+            return time[0] * 1e3 + time[1] / 1e6;
+        }
+
+        serial.on('found', function(address, name, eir, device) {
+            if (first === null) {
+                first = elapsed();
+            }
+            if (devices[address]) {
+                console.log('  reported twice: ' + address);
+            }
+            devices[address] = device;
+            console.log('  ' + elapsed().toFixed(0) + ' ms ' + address + ' ' + name +
+                        ' rssi ' + (device.rssi === undefined ? '-' : device.rssi) + ' via ' + device.adapter);
+        });
+
+        serial.on('finished', function() {
+            console.log(label + ': ' + Object.keys(devices).length + ' devices, first after ' +
+                        (first === null ? '-' : first.toFixed(0) + ' ms') + ', done after ' + elapsed().toFixed(0) + ' ms');
+            done(devices);
+        });
+
+        console.log(label + ':');
+        serial.inquire(options);
+    }
+
+    console.log('adapters: ' + bt.getAdapters().map(function(adapter) {
+        return adapter.name + ' ' + adapter.address;
+    }).join(', '));
+
+    run('default adapter', { length: length }, function(single) {
+        run('all adapters', { length: length, adapters: 'all' }, function(all) {
+            var missed = Object.keys(all).filter(function(address) {
+                return !single[address];
+            });
+            console.log('only found over all adapters: ' + (missed.length ? missed.join(', ') : 'none'));
+        });
+    });
+})();
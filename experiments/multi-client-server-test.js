@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Accepts many clients at once on a multi-client server. A unix socket stands
+// in for RFCOMM, so no Bluetooth hardware or SDP daemon is needed. Every
+// client sends a line, the server echoes it on the connection of that client.
+//
+// usage: node experiments/multi-client-server-test.js [clients]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var clients = parseInt(process.argv[2], 10) || 20,
+        socketPath = path.join(os.tmpdir(), 'btsp-multi-client-' + process.pid + '.sock'),
+        echoed = 0;
+
+    var server = new bt.BluetoothSerialPortServer();
+
+    server.on('connection', function(connection) {
+        connection.on('data', function(buffer) {
+            connection.write(buffer, function(err) {
+                if (err) console.log('Echo failed: ' + err);
+            });
+        });
+    });
+
+    server.listen(function() {}, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, { path: socketPath, backlog: clients });
+
+    // give the worker a moment to bind and listen
+    setTimeout(function() {
+        var start = Date.now();
+
+        for (var i = 0; i < clients; i++) {
+            (function(id) {
+                var socket = net.connect(socketPath, function() {
+                    socket.write('hello from ' + id);
+                });
+
+                socket.on('data', function(buffer) {
+                    if (buffer.toString() !== 'hello from ' + id) {
+                        console.log('Client ' + id + ' got: ' + buffer);
+                    }
+                    socket.end();
+
+                    if (++echoed === clients) {
+                        console.log(clients + ' clients echoed in ' + (Date.now() - start) + ' ms, ' +
+                                    server.connections.length + ' connections still open');
+                        server.close();
+                        fs.unlinkSync(socketPath);
+                    }
+                });
+            })(i);
+        }
+    }, 100);
+})();
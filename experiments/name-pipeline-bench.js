@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Scans twice, once reading the names one at a time and once with several
+// remote name requests outstanding, and prints when each device came in.
+// Needs an adapter and discoverable devices around.
+//
+// usage: node experiments/name-pipeline-bench.js [nameConcurrency] [nameTimeout ms]
+
+(function() {
+    "use strict";
+
+    var BluetoothSerialPort = require("../lib/bluetooth-serial-port.js").BluetoothSerialPort;
+
+    var concurrency = parseInt(process.argv[2], 10) || 4,
+        nameTimeout = parseInt(process.argv[3], 10) || 5000;
+
+    function scan(options, next) {
+        var serial = new BluetoothSerialPort(),
+            start = process.hrtime(),
+            devices = 0,
+            unnamed = 0;
+
+        function elapsed() {
+            var time = process.hrtime(start);
+            return (time[0] * 1e3 + time[1] / 1e6).toFixed(0) + ' ms';
+        }
+
+        serial.on('found', function(address, name) {
+            devices++;
+            if (name === address) {
+                unnamed++;
+            }
+            console.log('  ' + elapsed() + ' ' + address + ' ' + name);
+        });
+
+        serial.on('finished', function() {
+            console.log('nameConcurrency ' + options.nameConcurrency + ': ' + devices + ' devices, ' +
+                        unnamed + ' without a name, done after ' + elapsed());
+            next();
+        });
+
+        serial.inquire(options);
+    }
+
+    scan({ nameConcurrency: 1, nameTimeout: nameTimeout }, function() {
+        scan({ nameConcurrency: concurrency, nameTimeout: nameTimeout }, function() {});
+    });
+})();
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Lists the paired devices from a BlueZ store laid out in a temporary
+// directory: one adapter with a device paired over BR/EDR, one over LE and
+// one that was only seen, and a second adapter the first device is paired
+// with too. The cache of the first device holds a serial port record and
+// an L2CAP only record as BlueZ writes them. Checks the devices, their
+// names, classes and services come out of the store as written.
+//
+// usage: node experiments/paired-storage-test.js
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var os = require('os');
+    var path = require('path');
+    var assert = require('assert');
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var ADAPTER = '00:1A:7D:DA:71:13',
+        SECOND_ADAPTER = '00:1A:7D:DA:71:14',
+        PHONE = '11:22:33:44:55:66',
+        KEYBOARD = 'C0:FF:EE:00:00:01',
+        STRANGER = 'AA:BB:CC:DD:EE:FF';
+
+    var SPP_RECORD = '35310900000a000100010900013503191101090004350c350319010035051900030803090100250b53657269616c20506f7274',
+        HID_RECORD = '35250900000a000100020900013503191124090004350835061901000900110901002503484944';
+
+    var root = fs.mkdtempSync(path.join(os.tmpdir(), 'bluez-store-'));
+
+    function write(file, lines) {
+        fs.mkdirSync(path.dirname(path.join(root, file)), { recursive: true });
+        fs.writeFileSync(path.join(root, file), lines.join('\n') + '\n');
+    }
+
+    write(ADAPTER + '/settings', ['[General]', 'Discoverable=false']);
+    write(ADAPTER + '/' + PHONE + '/info', [
+        '[General]',
+        'Name=My\\sPhone',
+        'Class=0x5a020c',
+        'SupportedTechnologies=BR/EDR;',
+        'Trusted=true',
+        'Services=00001101-0000-1000-8000-00805f9b34fb;00001124-0000-1000-8000-00805f9b34fb;',
+        '',
+        '[LinkKey]',
+        'Key=0123456789ABCDEF0123456789ABCDEF',
+        'Type=4',
+        'PINLength=0'
+    ]);
+    write(ADAPTER + '/cache/' + PHONE, [
+        '[General]',
+        'Name=My Phone',
+        '',
+        '[ServiceRecords]',
+        '0x00010001=' + SPP_RECORD,
+        '0x00010002=' + HID_RECORD
+    ]);
+    write(ADAPTER + '/' + KEYBOARD + '/info', [
+        '[General]',
+        'SupportedTechnologies=LE;',
+        '',
+        '[LongTermKey]',
+        'Key=0123456789ABCDEF0123456789ABCDEF'
+    ]);
+    write(ADAPTER + '/cache/' + KEYBOARD, ['[General]', 'Name=Keyboard']);
+    write(ADAPTER + '/' + STRANGER + '/info', ['[General]', 'Name=Only seen']);
+    write(SECOND_ADAPTER + '/' + PHONE + '/info', ['[General]', 'Name=My Phone', '[LinkKey]', 'Key=00']);
+    write('not-an-adapter/' + PHONE + '/info', ['[General]', 'Name=Ignored', '[LinkKey]', 'Key=00']);
+
+    var serial = new bt.BluetoothSerialPort(),
+        start = process.hrtime();
+
+    serial.listPairedDevices(function(devices) {
+        var time = process.hrtime(start);
+        console.log(JSON.stringify(devices, null, 2));
+        console.log('listed in ' + (time[0] * 1e3 + time[1] / 1e6).toFixed(2) + ' ms');
+
+        try {
+            assert.deepStrictEqual(devices.map(function(d) { return d.adapter + ' ' + d.address; }), [
+                ADAPTER + ' ' + PHONE,
+                ADAPTER + ' ' + KEYBOARD,
+                SECOND_ADAPTER + ' ' + PHONE
+            ]);
+
+            var phone = devices[0];
+            assert.strictEqual(phone.name, 'My Phone');
+            assert.strictEqual(phone.deviceClass, 0x5a020c);
+            assert.strictEqual(phone.uuids.length, 2);
+            assert.deepStrictEqual(phone.services, [{
+                handle: 0x00010001,
+                name: 'Serial Port',
+                channel: 3,
+                uuids: ['00001101-0000-1000-8000-00805f9b34fb']
+            }, {
+                handle: 0x00010002,
+                name: 'HID',
+                psm: 0x11,
+                uuids: ['00001124-0000-1000-8000-00805f9b34fb']
+            }]);
+
+            // the name comes from the cache when the info file has none
+            assert.strictEqual(devices[1].name, 'Keyboard');
+            assert.strictEqual(devices[1].deviceClass, undefined);
+            assert.deepStrictEqual(devices[1].services, []);
+            console.log('OK');
+        } catch (err) {
+            console.log('FAILED: ' + err.message);
+            process.exitCode = 1;
+        }
+
+        fs.rmSync(root, { recursive: true, force: true });
+    }, { storageDir: root });
+})();
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Runs a continuous discovery against a fake controller on the other end of
+// a socket pair. Each inquiry the controller answers from a script: two
+// devices, one of them moving away, then one of them gone. Checks that only
+// the changes come out, that names are read once and that stopping cancels
+// the running inquiry.
+//
+// usage: node experiments/presence-discovery-test.js
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var OPCODE_INQUIRY = 0x0401,
+        OPCODE_INQUIRY_CANCEL = 0x0402,
+        OPCODE_REMOTE_NAME_REQ = 0x0419;
+
+    var EVT_INQUIRY_COMPLETE = 0x01,
+        EVT_REMOTE_NAME_REQ_COMPLETE = 0x07,
+        EVT_CMD_STATUS = 0x0f,
+        EVT_CMD_COMPLETE = 0x0e,
+        EVT_INQUIRY_RESULT_WITH_RSSI = 0x22;
+
+    var names = {
+        '00:11:22:33:44:0A': 'Staying',
+        '00:11:22:33:44:0B': 'Moving away'
+    };
+
+    // RSSI of each device in each inquiry, a missing device does not answer
+    var rounds = [
+        { '00:11:22:33:44:0A': -60, '00:11:22:33:44:0B': -60 },
+        { '00:11:22:33:44:0A': -62, '00:11:22:33:44:0B': -70 },
+        { '00:11:22:33:44:0A': -61 },
+        { '00:11:22:33:44:0A': -60 },
+        { '00:11:22:33:44:0A': -63 },
+        { '00:11:22:33:44:0A': -60 }
+    ];
+
+    function bdaddr(address) {
+        return Buffer.from(address.split(':').reverse().map(function(b) { return parseInt(b, 16); }));
+    }
+
+    function event(code, params) {
+        return Buffer.concat([Buffer.from([0x04, code, params.length]), params]);
+    }
+
+    function cmdStatus(opcode) {
+        return event(EVT_CMD_STATUS, Buffer.from([0, 1, opcode & 0xff, opcode >> 8]));
+    }
+
+    function resultWithRssi(address, rssi) {
+        return event(EVT_INQUIRY_RESULT_WITH_RSSI, Buffer.concat([Buffer.from([1]), bdaddr(address),
+            Buffer.from([1, 0, 0x0c, 0x02, 0x5a, 0x34, 0x12, rssi & 0xff])]));
+    }
+
+    function remoteNameComplete(address, name) {
+        var field = Buffer.alloc(248);
+        field.write(name);
+        return event(EVT_REMOTE_NAME_REQ_COMPLETE, Buffer.concat([Buffer.from([0]), bdaddr(address), field]));
+    }
+
+    var pair = bt.socketPair('seqpacket'),
+        hci = pair[0],
+        controller = pair[1],
+        round = 0,
+        nameRequests = 0,
+        cancelled = false,
+        serial = new bt.BluetoothSerialPort(),
+        events = [];
+
+    function send(packet, delay) {
+        setTimeout(function() {
+            fs.writeSync(controller, packet);
+        }, delay || 0);
+    }
+
+    function command(packet) {
+        var opcode = packet.readUInt16LE(1);
+
+        if (opcode === OPCODE_INQUIRY) {
+            send(cmdStatus(opcode));
+            if (round === rounds.length) {
+                // leave this one running, stopping has to cancel it
+                serial.stopDiscovery();
+                return;
+            }
+            var answers = rounds[round++];
+            Object.keys(answers).forEach(function(address) {
+                send(resultWithRssi(address, answers[address]), 50);
+            });
+            send(event(EVT_INQUIRY_COMPLETE, Buffer.from([0])), 200);
+        } else if (opcode === OPCODE_REMOTE_NAME_REQ) {
+            var address = Array.prototype.slice.call(packet.slice(4, 10)).reverse().map(function(b) {
+                return ('0' + b.toString(16)).slice(-2);
+            }).join(':').toUpperCase();
+            nameRequests++;
+            send(cmdStatus(opcode));
+            send(remoteNameComplete(address, names[address]), 20);
+        } else if (opcode === OPCODE_INQUIRY_CANCEL) {
+            cancelled = true;
+            send(event(EVT_CMD_COMPLETE, Buffer.from([1, opcode & 0xff, opcode >> 8, 0])));
+        }
+    }
+
+    function receive() {
+        var buffer = Buffer.alloc(260);
+        fs.read(controller, buffer, 0, buffer.length, null, function(err, length) {
+            if (err || length === 0) {
+                fs.closeSync(controller);
+                return;
+            }
+            if (buffer[0] === 0x01 && length >= 4) {
+                command(buffer.slice(0, length));
+            }
+            receive();
+        });
+    }
+    receive();
+
+    ['deviceFound', 'deviceChanged', 'deviceLost'].forEach(function(name) {
+        serial.on(name, function(device) {
+            console.log('  ' + name + ' ' + device.address + ' ' + device.name + ' ' + device.rssi + ' dBm');
+            events.push(name + ' ' + device.address);
+        });
+    });
+
+    serial.on('discoveryStopped', function(err) {
+        fs.closeSync(hci);
+
+        var expected = [
+            'deviceFound 00:11:22:33:44:0A',
+            'deviceFound 00:11:22:33:44:0B',
+            'deviceChanged 00:11:22:33:44:0B',
+            'deviceLost 00:11:22:33:44:0B'
+        ];
+        var failed = false;
+        if (err) {
+            console.log('stopped with ' + err);
+            failed = true;
+        }
+        if (events.sort().join() !== expected.sort().join()) {
+            console.log('expected ' + expected.join(', '));
+            failed = true;
+        }
+        if (nameRequests !== 2) {
+            console.log(nameRequests + ' names asked for, expected 2');
+            failed = true;
+        }
+        if (!cancelled) {
+            console.log('the last inquiry was not cancelled');
+            failed = true;
+        }
+        console.log(failed ? 'FAILED' : 'OK');
+        process.exitCode = failed ? 1 : 0;
+    });
+
+    serial.startDiscovery({ hciSocket: hci, length: 1, rssiDelta: 6, lostAfter: 600 });
+})();
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Runs a single client server against a stand-in for the SDP daemon and
+// counts the service registrations while clients come and go. The record is
+// registered once for the lifetime of the server. A unix socket stands in for
+// RFCOMM, so no hardware or bluetoothd is needed.
+//
+// usage: node experiments/sdp-stand-in-test.js [clients]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var clients = parseInt(process.argv[2], 10) || 10,
+        socketPath = path.join(os.tmpdir(), 'btsp-sdp-server-' + process.pid + '.sock'),
+        sdpPath = path.join(os.tmpdir(), 'btsp-sdp-daemon-' + process.pid + '.sock'),
+        registrations = 0,
+        sessions = 0,
+        SDP_SVC_REGISTER_REQ = 0x75,
+        SDP_SVC_REGISTER_RSP = 0x76;
+
+    // answers register requests the way the SDP daemon does
+    var sdpd = net.createServer(function(session) {
+        sessions++;
+        session.on('data', function(pdu) {
+            if (pdu[0] !== SDP_SVC_REGISTER_REQ) {
+                console.log('Unexpected SDP request 0x' + pdu[0].toString(16));
+                return;
+            }
+
+            registrations++;
+            var rsp = Buffer.alloc(9);
+            rsp[0] = SDP_SVC_REGISTER_RSP;
+            pdu.copy(rsp, 1, 1, 3); // transaction id
+            rsp.writeUInt16BE(4, 3);
+            rsp.writeUInt32BE(0x10000 + registrations, 5);
+            session.write(rsp);
+        });
+        session.on('close', function() {
+            console.log('SDP session closed, the record is gone');
+        });
+    });
+
+    function connectClient(remaining) {
+        if (remaining === 0) {
+            console.log(clients + ' clients, ' + registrations + ' registrations over ' + sessions + ' SDP sessions');
+            server.close();
+            setTimeout(function() {
+                sdpd.close();
+                fs.unlinkSync(socketPath);
+            }, 100);
+            return;
+        }
+
+        var socket = net.connect(socketPath, function() {
+            socket.end('hello');
+        });
+        socket.on('close', function() {
+            connectClient(remaining - 1);
+        });
+    }
+
+    var server = new bt.BluetoothSerialPortServer();
+
+    sdpd.listen(sdpPath, function() {
+        server.listen(function() {}, function(err) {
+            console.log('Listen failed: ' + err);
+            process.exit(1);
+        }, { path: socketPath, sdpPath: sdpPath });
+
+        setTimeout(function() {
+            connectClient(clients);
+        }, 100);
+    });
+})();
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Pushes multi-MB payloads from the server to a client over a unix socket
+// with a small send buffer, so every write is cut short many times and has to
+// wait for the socket to drain. Every write has to report its full length.
+//
+// usage: node experiments/server-write-bench.js [MB per write] [writes] [send buffer]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var size = (parseFloat(process.argv[2]) || 4) * 1024 * 1024,
+        writes = parseInt(process.argv[3], 10) || 8,
+        sendBufferSize = parseInt(process.argv[4], 10) || 4096,
+        socketPath = path.join(os.tmpdir(), 'btsp-write-bench-' + process.pid + '.sock'),
+        payload = Buffer.alloc(size, 0x5a),
+        received = 0,
+        failures = 0,
+        start;
+
+    var server = new bt.BluetoothSerialPortServer();
+
+    function done() {
+        var seconds = (Date.now() - start) / 1000;
+        console.log(writes + ' x ' + (size / 1024 / 1024) + ' MB, send buffer ' + sendBufferSize + ' B: ' +
+                    seconds.toFixed(2) + ' s, ' + (received / 1024 / 1024 / seconds).toFixed(1) + ' MB/s, ' +
+                    failures + ' failed writes');
+        server.close();
+        fs.unlinkSync(socketPath);
+        process.exit(failures ? 1 : 0);
+    }
+
+    server.listen(function() {
+        start = Date.now();
+
+        for (var i = 0; i < writes; i++) {
+            server.write(payload, function(err, length) {
+                if (err || length !== size) {
+                    failures++;
+                    console.log('Short write: ' + (err || length));
+                }
+            });
+        }
+    }, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, { path: socketPath, sendBufferSize: sendBufferSize });
+
+    setTimeout(function() {
+        var client = net.connect(socketPath);
+
+        client.on('data', function(buffer) {
+            received += buffer.length;
+            if (received === size * writes) {
+                client.destroy();
+                done();
+            }
+        });
+    }, 100);
+})();
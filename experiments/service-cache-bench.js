@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Reads the services of a device three times: a full search that pages the
+// device, the same search again, answered from the service cache, and a
+// serial port search, also answered from the cache. Prints the records and
+// how long each took. With a cache file the cache is kept between runs, so
+// a second run answers the first search from the file too.
+//
+// usage: node experiments/service-cache-bench.js address [cacheFile]
+
+(function() {
+    "use strict";
+
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var address = process.argv[2],
+        cacheFile = process.argv[3];
+
+    if (!address) {
+        console.log('usage: node experiments/service-cache-bench.js address [cacheFile]');
+        process.exit(1);
+    }
+
+    var serial = new bt.BluetoothSerialPort(),
+        options = cacheFile ? { cacheFile: cacheFile } : {};
+
+    function timer() {
+        var start = process.hrtime();
+        return function() {
+            var time = process.hrtime(start);
+            return (time[0] * 1e3 + time[1] / 1e6).toFixed(1) + ' ms';
+        };
+    }
+
+    function search(label, done) {
+        var elapsed = timer();
+        serial.discoverServices(address, function(err, services, cached) {
+            if (err) {
+                console.log(label + ' failed after ' + elapsed() + ': ' + err.message);
+                process.exit(1);
+            }
+            console.log(label + ': ' + services.length + ' records ' + (cached ? 'from the cache' : 'from the device') +
+                        ' after ' + elapsed());
+            done(services);
+        }, options);
+    }
+
+    search('first search', function(services) {
+        services.forEach(function(service) {
+            console.log('  ' + JSON.stringify(service));
+        });
+
+        search('second search', function() {
+            var elapsed = timer();
+            serial.findSerialPortChannel(address, function(channel) {
+                console.log('serial port channel ' + channel + ' after ' + elapsed());
+            }, function() {
+                console.log('no serial port channel, after ' + elapsed());
+            });
+        });
+    });
+})();
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Runs parseServiceRecords against the attribute lists of service search
+// attribute responses as devices send them, and checks what comes out:
+// a serial port record, an L2CAP only record with a PSM and a record with
+// a 128 bit service class UUID.
+//
+// usage: node experiments/service-records-test.js
+
+(function() {
+    "use strict";
+
+    var assert = require('assert');
+    var bt = require("../lib/bluetooth-serial-port.js");
+
+    var SPP_RECORD = '35310900000a000100010900013503191101090004350c350319010035051900030803090100250b53657269616c20506f7274',
+        HID_RECORD = '35250900000a000100020900013503191124090004350835061901000900110901002503484944',
+        CUSTOM_RECORD = '353a0900000a0001000309000135111c8ce255c0200a11e0ac640800200c9a66090004350c3503190100350519000308050901002506437573746f6d';
+
+    var SPP = { handle: 0x00010001, name: 'Serial Port', channel: 3, uuids: ['00001101-0000-1000-8000-00805f9b34fb'] },
+        HID = { handle: 0x00010002, name: 'HID', psm: 0x11, uuids: ['00001124-0000-1000-8000-00805f9b34fb'] },
+        CUSTOM = { handle: 0x00010003, name: 'Custom', channel: 5, uuids: ['8ce255c0-200a-11e0-ac64-0800200c9a66'] };
+
+    function lists(records) {
+        var body = Buffer.from(records.join(''), 'hex');
+        return Buffer.concat([Buffer.from([0x35, body.length]), body]);
+    }
+
+    var responses = [{
+        what: 'three records',
+        response: lists([SPP_RECORD, HID_RECORD, CUSTOM_RECORD]),
+        expected: [SPP, HID, CUSTOM]
+    }, {
+        what: 'no records',
+        response: Buffer.from('3500', 'hex'),
+        expected: []
+    }, {
+        what: 'attribute lists in a sequence with a 16 bit length',
+        response: Buffer.concat([Buffer.from('3600' + (SPP_RECORD.length / 2).toString(16), 'hex'), Buffer.from(SPP_RECORD, 'hex')]),
+        expected: [SPP]
+    }, {
+        what: 'last record cut short',
+        response: lists([SPP_RECORD, HID_RECORD.slice(0, -8)]),
+        expected: [SPP]
+    }];
+
+    responses.forEach(function(capture) {
+        assert.deepStrictEqual(bt.parseServiceRecords(capture.response), capture.expected, capture.what);
+        console.log('ok ' + capture.what);
+    });
+
+    // not a sequence at all, or one longer than the buffer
+    assert.throws(function() {
+        bt.parseServiceRecords(Buffer.from('0900010a00', 'hex'));
+    }, TypeError);
+    assert.throws(function() {
+        var full = lists([SPP_RECORD]);
+        bt.parseServiceRecords(full.slice(0, full.length - 4));
+    }, TypeError);
+    console.log('ok no sequence');
+})();
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Runs many short sessions against a single-client server: each client
+// connects, sends a few bytes and hangs up. Memory is sampled after a
+// warm-up and again at the end. It should stay flat, a leak on the
+// disconnect path shows up as growth proportional to the number of
+// sessions. Exits with 1 when the growth is over the limit. A unix socket
+// stands in for RFCOMM.
+//
+// usage: node --expose-gc experiments/session-churn-bench.js [cycles] [limit KB]
+
+(function() {
+    "use strict";
+
+    var fs = require('fs');
+    var net = require('net');
+    var os = require('os');
+    var path = require('path');
+    var bt = require('../lib/bluetooth-serial-port.js');
+
+    var cycles = parseInt(process.argv[2], 10) || 10000,
+        limit = (parseInt(process.argv[3], 10) || 2048) * 1024,
+        warmup = Math.min(1000, Math.floor(cycles / 10)),
+        socketPath = path.join(os.tmpdir(), 'btsp-session-churn-' + process.pid + '.sock'),
+        baseline,
+        start;
+
+    function sample() {
+        if (global.gc) {
+            global.gc();
+        }
+        return process.memoryUsage();
+    }
+
+    function kb(bytes) {
+        return (bytes / 1024).toFixed(0) + ' KB';
+    }
+
+    var server = new bt.BluetoothSerialPortServer();
+    server.on('data', function() {});
+
+    function cycle(done) {
+        if (done === warmup) {
+            baseline = sample();
+            start = process.hrtime();
+        }
+
+        if (done === cycles) {
+            var time = process.hrtime(start),
+                end = sample(),
+                growth = end.rss - baseline.rss;
+
+            console.log((cycles - warmup) + ' sessions in ' + (time[0] * 1e3 + time[1] / 1e6).toFixed(0) + ' ms');
+            console.log('rss ' + kb(baseline.rss) + ' -> ' + kb(end.rss) +
+                        ', heap ' + kb(baseline.heapUsed) + ' -> ' + kb(end.heapUsed) +
+                        ', external ' + kb(baseline.external) + ' -> ' + kb(end.external));
+            console.log(growth > limit ? 'FAIL: grew ' + kb(growth) : 'ok');
+
+            server.close();
+            fs.unlinkSync(socketPath);
+            process.exitCode = growth > limit ? 1 : 0;
+            return;
+        }
+
+        var socket = net.connect(socketPath, function() {
+            socket.end('hello');
+        });
+        socket.resume();
+        socket.on('close', function() {
+            // the server has to see the hang-up before the next client fits in
+            setImmediate(cycle, done + 1);
+        });
+    }
+
+    if (!global.gc) {
+        console.log('run with --expose-gc for stable numbers');
+    }
+
+    server.listen(function() {}, function(err) {
+        console.log('Listen failed: ' + err);
+        process.exit(1);
+    }, { path: socketPath });
+
+    setTimeout(function() {
+        cycle(0);
+    }, 100);
+})();
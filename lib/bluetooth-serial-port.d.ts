@@ -7,33 +7,166 @@
 import { EventEmitter } from "events";
 
 declare module BluetoothSerialPort {
+  interface SocketOptions {
+    sendBufferSize?: number;
+    receiveBufferSize?: number;
+    priority?: number;
+    linkMode?: string | number;
+    mtu?: number;
+    adapter?: string | number;
+    idleTimeout?: number;
+    keepaliveInterval?: number;
+    keepaliveData?: Buffer | string;
+  }
+  interface ConnectOptions extends SocketOptions {
+    writeMode?: "default" | "mtu";
+  }
+  interface SocketInfo {
+    address: string;
+    channel: number;
+    adapter: string;
+    mtu: number;
+    sendBufferSize: number;
+    receiveBufferSize: number;
+    priority: number;
+    linkMode: number;
+  }
+  interface ExtendedInquiryResponse {
+    name?: string;
+    nameComplete?: boolean;
+    txPower?: number;
+    uuids: string[];
+  }
+  interface InquiryOptions {
+    nameConcurrency?: number;
+    nameTimeout?: number;
+    hciSocket?: number;
+    cacheTtl?: number;
+    cacheFile?: string;
+    length?: number;
+    maxResponses?: number;
+    lap?: "giac" | "liac" | number;
+    flushCache?: boolean;
+    adapters?: "all" | Array<string | number>;
+  }
+  interface DiscoveryOptions extends InquiryOptions {
+    interval?: number;
+    rssiDelta?: number;
+    lostAfter?: number;
+  }
+  interface DiscoveredDevice {
+    address: string;
+    name: string;
+    rssi?: number;
+    deviceClass: number;
+    adapter?: string;
+    eir?: ExtendedInquiryResponse;
+  }
+  interface ServiceRecord {
+    handle?: number;
+    name?: string;
+    channel?: number;
+    psm?: number;
+    uuids?: string[];
+  }
+  interface PairedDevice {
+    name: string;
+    address: string;
+    adapter?: string;
+    deviceClass?: number;
+    uuids?: string[];
+    services: ServiceRecord[];
+  }
+  interface ServiceDiscoveryOptions {
+    cacheTtl?: number;
+    cacheFile?: string;
+  }
+  interface PairedDeviceOptions {
+    storageDir?: string;
+  }
+  interface Cancellable {
+    cancel(): void;
+  }
   class BluetoothSerialPort extends EventEmitter {
     constructor();
-    inquire(): void;
-    inquireSync(): void;
+    static fromFd(fd: number, options?: ConnectOptions): BluetoothSerialPort;
+    inquire(options?: InquiryOptions): Cancellable;
+    inquireSync(options?: InquiryOptions): void;
+    startDiscovery(options?: DiscoveryOptions): void;
+    stopDiscovery(): void;
     findSerialPortChannel(
         address: string, successCallback: (channel: number) => void,
-        errorCallback?: () => void): void;
+        errorCallback?: (err?: Error) => void): Cancellable;
+    discoverServices(
+        address: string, callback: (err: Error | null, services?: ServiceRecord[], cached?: boolean) => void,
+        options?: ServiceDiscoveryOptions): Cancellable;
     connect(
         address: string, channel: number, successCallback: () => void,
-        errorCallback?: (err?: Error) => void): void;
+        errorCallback?: (err?: Error) => void, options?: ConnectOptions): void;
     write(buffer: Buffer, cb: (err?: Error) => void): void;
     close(): void;
     isOpen(): boolean;
-    listPairedDevices(cb: (devices: any) => void): void;
+    getSocketInfo(): SocketInfo;
+    detach(): number;
+    listPairedDevices(cb: (devices: PairedDevice[]) => void, options?: PairedDeviceOptions): void;
+  }
+  interface Service {
+    uuid: string;
+    channel: number;
+  }
+  interface BroadcastOptions {
+    policy?: "skip" | "queue";
+    maxQueuedBytes?: number;
+  }
+  interface BroadcastResult {
+    connection: BluetoothSerialPort;
+    bytesWritten?: number;
+    error?: Error;
+  }
+  interface ServerStats {
+    clients: number;
+    accepted: number;
+    rejected: number;
+    rejectedFilter: number;
+    rejectedMaxClients: number;
+    rejectedRate: number;
   }
   class BluetoothSerialPortServer {
     constructor();
+    connections: BluetoothSerialPort[];
     listen(
-        successCallback: (clientAddress: string) => void,
+        successCallback: (clientAddress: string, connection: BluetoothSerialPort | undefined, service: Service) => void,
         errorCallback?: (err: any) => void,
-        options?: {uuid?: string; channel: number;}): void;
+        options?: {uuid?: string; channel?: number; services?: Service[]; fd?: number; backlog?: number; path?: string; sdpPath?: string;
+                   maxClients?: number; acceptRate?: number; acceptBurst?: number; allow?: string[]; deny?: string[];} & ConnectOptions): void;
     on(event: string, callback: (arg1:any, arg2:any) => void): void;
     write(buffer: Buffer, callback: (err?: Error) => void): void;
+    broadcast(
+        buffer: Buffer, options: BroadcastOptions,
+        callback: (err: Error | undefined, results: BroadcastResult[]) => void): void;
+    broadcast(buffer: Buffer, callback: (err: Error | undefined, results: BroadcastResult[]) => void): void;
     close(): void;
     disconnectClient(): void;
+    detachClient(): number;
     isOpen(): boolean;
+    getSocketInfo(): SocketInfo;
+    getStats(): ServerStats;
+  }
+  function sendFd(channel: number, fd: number): void;
+  function receiveFd(channel: number, callback: (err: Error | null, fd?: number) => void): void;
+  function socketPair(type?: "stream" | "seqpacket"): [number, number];
+  function parseEir(buffer: Buffer): ExtendedInquiryResponse;
+  function parseServiceRecords(buffer: Buffer): ServiceRecord[];
+  interface AdapterLoad {
+    links: number;
+    throughput: number;
+  }
+  interface Adapter extends AdapterLoad {
+    name: string;
+    address: string;
   }
+  function getAdapters(): Adapter[];
+  function chooseAdapter(adapters: AdapterLoad[]): number;
 }
 
 export = BluetoothSerialPort;
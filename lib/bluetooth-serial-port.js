@@ -18,7 +18,8 @@
     var util = require('util'),
         EventEmitter = require('events').EventEmitter,
         btSerial = require('bindings')('BluetoothSerialPort.node'),
-        DeviceINQ = require("./device-inquiry.js").DeviceINQ;
+        DeviceINQ = require("./device-inquiry.js").DeviceINQ,
+        _ERROR_IDLE_TIMEOUT = 'Idle timeout';
 
     /**
      * Creates an instance of the bluetooth-serial object.
@@ -32,48 +33,185 @@
 
         var self = this;
 
-        this.found = function (address, name) {
-            self.emit('found', address, name);
+        this.found = function (address, name, eir, device) {
+            self.emit('found', address, name, eir, device);
         }
 
-        this.finish = function () {
-            self.emit('finished');
+        this.finish = function (err, cancelled) {
+            self.emit(cancelled === true ? 'cancelled' : 'finished');
         }
     }
 
+    // What an inquiry or a search returns to cancel it by. Only the linux
+    // binding hands out ids, elsewhere cancelling does nothing.
+    function operationHandle(inq, id) {
+        var done = false;
+        return {
+            cancel: function () {
+                if (!done && typeof id === 'number') {
+                    done = true;
+                    inq.cancel(id);
+                }
+            }
+        };
+    }
+
     util.inherits(BluetoothSerialPort, EventEmitter);
     exports.BluetoothSerialPort = BluetoothSerialPort;
 
-    BluetoothSerialPort.prototype.listPairedDevices = function (callback) {
-        this.inq.listPairedDevices(callback);
+    if (process.platform === 'linux') {
+        // passing connected sockets between processes over unix sockets
+        exports.sendFd = btSerial.BTSerialPortBinding.sendFd;
+        exports.receiveFd = btSerial.BTSerialPortBinding.receiveFd;
+        exports.socketPair = btSerial.BTSerialPortBinding.socketPair;
+
+        // what devices tell about themselves during an inquiry
+        exports.parseEir = DeviceINQ.parseEir;
+        exports.parseServiceRecords = DeviceINQ.parseServiceRecords;
+
+        // spreading connections over multiple adapters
+        exports.getAdapters = btSerial.BTSerialPortBinding.getAdapters;
+        exports.chooseAdapter = btSerial.BTSerialPortBinding.chooseAdapter;
+    }
+
+    BluetoothSerialPort.prototype.listPairedDevices = function (callback, options) {
+        if (options) {
+            // only the linux binding takes options
+            this.inq.listPairedDevices(callback, options);
+        } else {
+            this.inq.listPairedDevices(callback);
+        }
+    };
+
+    BluetoothSerialPort.prototype.inquire = function (options) {
+        var id;
+        if (options) {
+            // only the linux binding takes options
+            id = this.inq.inquire(this.found, this.finish, options);
+        } else {
+            id = this.inq.inquire(this.found, this.finish);
+        }
+        return operationHandle(this.inq, id);
+    };
+
+    BluetoothSerialPort.prototype.startDiscovery = function (options) {
+        if (typeof this.inq.discover !== 'function') {
+            throw new Error('Continuous discovery is only supported on Linux.');
+        }
+
+        var self = this;
+        this.inq.discover(function (event, device) {
+            self.emit(event, device);
+        }, function (err) {
+            self.emit('discoveryStopped', err);
+        }, options || {});
     };
 
-    BluetoothSerialPort.prototype.inquire = function () {
-        this.inq.inquire(this.found, this.finish);
+    BluetoothSerialPort.prototype.stopDiscovery = function () {
+        if (typeof this.inq.stopDiscovery === 'function') {
+            this.inq.stopDiscovery();
+        }
     };
 
-    BluetoothSerialPort.prototype.inquireSync = function () {
-        this.inq.inquireSync(this.found, this.finish);
+    BluetoothSerialPort.prototype.inquireSync = function (options) {
+        if (options) {
+            // only the linux binding takes options
+            this.inq.inquireSync(this.found, this.finish, options);
+        } else {
+            this.inq.inquireSync(this.found, this.finish);
+        }
     };
 
     BluetoothSerialPort.prototype.findSerialPortChannel = function (address, successCallback, errorCallback) {
-        this.inq.findSerialPortChannel(address, function (channel) {
+        var id = this.inq.findSerialPortChannel(address, function (channel, cancelled) {
             if (channel >= 0) {
                 successCallback(channel);
             } else if (errorCallback) {
-                errorCallback();
+                if (cancelled === true) {
+                    var err = new Error('The search was cancelled.');
+                    err.code = 'ECANCELED';
+                    errorCallback(err);
+                } else {
+                    errorCallback();
+                }
             }
         });
+        return operationHandle(this.inq, id);
     };
 
-    BluetoothSerialPort.prototype.connect = function (address, channel, successCallback, errorCallback) {
+    BluetoothSerialPort.prototype.discoverServices = function (address, callback, options) {
+        if (typeof this.inq.discoverServices !== 'function') {
+            throw new Error('Service discovery is only supported on Linux.');
+        }
+
+        var id = this.inq.discoverServices(address, function (err, services, cached) {
+            if (err) {
+                callback(err);
+            } else {
+                callback(null, services, cached);
+            }
+        }, options || {});
+        return operationHandle(this.inq, id);
+    };
+
+    BluetoothSerialPort.prototype.connect = function (address, channel, successCallback, errorCallback, options) {
+        if (errorCallback && typeof errorCallback !== 'function') {
+            options = errorCallback;
+            errorCallback = null;
+        }
+
+        var self = this,
+            connection = new btSerial.BTSerialPortBinding(address, channel, function () {
+                self._attach(connection, address);
+
+                successCallback();
+            }, function (err) {
+                // cleaning up the the failed connection
+                connection.close(address);
+
+                if (errorCallback) {
+                    errorCallback(err);
+                }
+            }, options || {});
+    };
+
+    /**
+     * Wraps an already connected socket, e.g. one handed over by a broker
+     * process or by systemd, in a BluetoothSerialPort. Linux only.
+     * @param fd The file descriptor of the connected socket.
+     * @param options Socket options, see `connect`.
+     */
+    BluetoothSerialPort.fromFd = function (fd, options) {
+        var port = new BluetoothSerialPort(),
+            connection = btSerial.BTSerialPortBinding.fromFd(fd, options || {});
+
+        port._attach(connection, connection.getSocketInfo().address);
+
+        return port;
+    };
+
+    BluetoothSerialPort.prototype._attach = function (connection, address) {
         var self = this,
             read = function () {
                 process.nextTick(function () {
                     if (self.connection) {
                         self.connection.read(function (err, buffer) {
+                            if (connection.detached) {
+                                // the socket has been handed over, but a read that was already
+                                // under way may have taken bytes off it, those are the last ones
+                                if (!err && buffer && buffer.length > 0) {
+                                    self.emit('data', buffer);
+                                }
+                                return;
+                            }
+
                             if (!err && buffer) {
                                 self.emit('data', buffer);
+                            } else if (err.message === _ERROR_IDLE_TIMEOUT) {
+                                // nothing came in for idleTimeout, the socket is already shut down
+                                self.removeListener('data', dataListener);
+                                self.emit('timeout');
+                                self.close();
                             } else {
                                 self.removeListener('data', dataListener);  // remove it to prevent
                                 self.close();                               // calling self.on many
@@ -91,26 +229,16 @@
                     } else {
                         read();
                     }
-            },
-            connection = new btSerial.BTSerialPortBinding(address, channel, function () {
-                self.address = address;
-                self.buffer = [];
-                self.connection = connection;
-                self.isReading = false;
+            };
 
-                self.on('data', dataListener); // add listener to event 'data'
+        self.address = address;
+        self.buffer = [];
+        self.connection = connection;
+        self.isReading = false;
 
-                read();
-
-                successCallback();
-            }, function (err) {
-                // cleaning up the the failed connection
-                connection.close(address);
+        self.on('data', dataListener); // add listener to event 'data'
 
-                if (errorCallback) {
-                    errorCallback(err);
-                }
-            });
+        read();
     };
 
     BluetoothSerialPort.prototype.write = function (buffer, cb) {
@@ -134,6 +262,39 @@
     BluetoothSerialPort.prototype.isOpen = function () {
         return this.connection !== undefined;
     };
+
+    /**
+     * Stops reading from the connection and releases its socket without closing
+     * it. The returned file descriptor can be passed to another process with
+     * `sendFd` and adopted there with `BluetoothSerialPort.fromFd`. Bytes that
+     * a read in progress already took off the socket follow as a last 'data'
+     * event. Linux only.
+     * @return The file descriptor of the connected socket.
+     */
+    BluetoothSerialPort.prototype.detach = function () {
+        if (!this.connection) {
+            throw new Error("Not connected");
+        }
+
+        var connection = this.connection,
+            fd = connection.detach();
+
+        connection.detached = true;
+        connection.close(this.address);
+        this.connection = undefined;
+
+        this.emit('detached');
+
+        return fd;
+    };
+
+    BluetoothSerialPort.prototype.getSocketInfo = function () {
+        if (!this.connection) {
+            throw new Error("Not connected");
+        }
+
+        return this.connection.getSocketInfo();
+    };
 }());
 
 (function () {
@@ -146,9 +307,13 @@
     var util = require('util'),
         EventEmitter = require('events').EventEmitter,
         btSerial = require('bindings')('BluetoothSerialPortServer.node'),
+        btSerialClient = require('bindings')('BluetoothSerialPort.node'),
         _SERIAL_PORT_PROFILE_UUID = '1101',
         _DEFAULT_SERVER_CHANNEL = 1,
-        _ERROR_CLIENT_CLOSED_CONNECTION = 'Error: Connection closed by the client';
+        _ERROR_CLIENT_CLOSED_CONNECTION = 'Error: Connection closed by the client',
+        _ERROR_IDLE_TIMEOUT = 'Idle timeout',
+        _ERROR_CONNECTION_LOST = 'Connection lost',
+        _DEFAULT_BROADCAST_MAX_QUEUED_BYTES = 1024 * 1024;
 
     /**
      * Creates an instance of the bluetooth-serial-server object.
@@ -157,6 +322,7 @@
     function BluetoothSerialPortServer() {
         EventEmitter.call(this);
         this.inDisconnect = false;
+        this.connections = [];
     }
 
     util.inherits(BluetoothSerialPortServer, EventEmitter);
@@ -193,8 +359,12 @@
                         if (!err && buffer) {
                             self.emit('data', buffer);
                             read();
-                        }else if (self.inDisconnect) {
-                            // We were told to disconnect, and now we've disconnected, so emit disconnected
+                        }else if (err && err.message === _ERROR_IDLE_TIMEOUT) {
+                            // the client was dropped natively, the server accepts the next one
+                            self.emit('timeout');
+                        }else if (self.inDisconnect || (err && err.message === _ERROR_CONNECTION_LOST)) {
+                            // We were told to disconnect or the link broke, either way the
+                            // server accepts the next client, so emit disconnected
                             self.inDisconnect = false;
                             self.emit('disconnected');
                         }else if(err != _ERROR_CLIENT_CLOSED_CONNECTION){
@@ -209,13 +379,80 @@
                 }
             });
         };
-        self.server = new btSerial.BTSerialPortBindingServer(function (clientAddress) {
+        // multi-client mode: every client gets its own BluetoothSerialPort. Returns
+        // true once the connection owns the socket, the native side closes it otherwise.
+        var accept = function (clientAddress, fd, service) {
+            if (!self.server) {
+                return false;
+            }
+
+            var connection;
+            try {
+                connection = exports.BluetoothSerialPort.fromFd(fd, {
+                    mtu: options.mtu,
+                    writeMode: options.writeMode,
+                    idleTimeout: options.idleTimeout,
+                    keepaliveInterval: options.keepaliveInterval,
+                    keepaliveData: options.keepaliveData
+                });
+            } catch (err) {
+                self.emit('failure', err);
+                return false;
+            }
+
+            // the native side counts connections against maxClients until they are gone
+            var released = false;
+            var release = function () {
+                if (released) {
+                    return;
+                }
+                released = true;
+
+                var index = self.connections.indexOf(connection);
+                if (index >= 0) {
+                    self.connections.splice(index, 1);
+                }
+                if (self.server) {
+                    self.server.releaseClient();
+                }
+            };
+
+            self.connections.push(connection);
+            connection.once('closed', release);
+            connection.once('detached', release);
+            connection.once('timeout', function () {
+                self.emit('timeout', connection);
+            });
+
+            // the socket is handed over now, an exception from the listeners
+            // must not make the native side close it under the connection
+            try {
+                if (typeof successCallback === 'function') {
+                    successCallback(clientAddress, connection, service);
+                }
+                self.emit('connection', connection, clientAddress, service);
+            } catch (err) {
+                process.nextTick(function () {
+                    throw err;
+                });
+            }
+
+            return true;
+        };
+
+        self.server = new btSerial.BTSerialPortBindingServer(function (clientAddress, fd, service) {
+            if (options.backlog) {
+                return accept(clientAddress, fd, service);
+            }
+
             read();
-            successCallback(clientAddress);
+            successCallback(clientAddress, undefined, service);
         }, function (err) {
             // cleaning up the the failed connection
-            if(this.server)
-                this.server.close();
+            if (self.server) {
+                self.server.close();
+                self.server = undefined;
+            }
             if (typeof errorCallback === 'function') {
                 errorCallback(err);
             }
@@ -231,6 +468,58 @@
         }
     };
 
+    /**
+     * Writes the same buffer to all connections of a multi-client server. The
+     * buffer is shared by all writes and the callback is called once.
+     * @param buffer The buffer to write.
+     * @param options `policy` is 'skip' (default) to leave out connections with
+     *     more than `maxQueuedBytes` (default 1 MB) waiting, or 'queue' to
+     *     write to every connection.
+     * @param callback Called with an array of { connection, bytesWritten } or
+     *     { connection, error } objects, one per connection.
+     */
+    BluetoothSerialPortServer.prototype.broadcast = function (buffer, options, callback) {
+        if (typeof options === 'function') {
+            callback = options;
+            options = {};
+        }
+        options = options || {};
+
+        if (!this.server) {
+            return callback(new Error("Not connected"));
+        }
+
+        var policy = options.policy || 'skip',
+            maxQueuedBytes = options.maxQueuedBytes === undefined ?
+                _DEFAULT_BROADCAST_MAX_QUEUED_BYTES : options.maxQueuedBytes;
+
+        if (policy !== 'skip' && policy !== 'queue') {
+            return callback(new Error("Policy should be either 'skip' or 'queue'"));
+        }
+
+        var connections = this.connections.filter(function (connection) {
+                return connection.connection;
+            }),
+            sync = true;
+
+        btSerialClient.BTSerialPortBinding.broadcast(connections.map(function (connection) {
+            return connection.connection;
+        }), buffer, policy === 'queue' ? -1 : maxQueuedBytes, function (written) {
+            var results = connections.map(function (connection, i) {
+                return written[i] instanceof Error ?
+                    { connection: connection, error: written[i] } :
+                    { connection: connection, bytesWritten: written[i] };
+            });
+
+            if (sync) {
+                process.nextTick(callback, undefined, results);
+            } else {
+                callback(undefined, results);
+            }
+        });
+        sync = false;
+    };
+
     BluetoothSerialPortServer.prototype.disconnectClient = function() {
         if (this.server) {
             this.inDisconnect = true;
@@ -238,11 +527,26 @@
         }
     };
 
+    BluetoothSerialPortServer.prototype.detachClient = function () {
+        if (!this.server) {
+            throw new Error("Not connected");
+        }
+
+        var fd = this.server.detachClient();
+        this.inDisconnect = true;
+
+        return fd;
+    };
+
     BluetoothSerialPortServer.prototype.close = function () {
         if (this.server) {
             this.server.close();
             this.server = undefined;
         }
+
+        this.connections.slice().forEach(function (connection) {
+            connection.close();
+        });
     };
 
     BluetoothSerialPortServer.prototype.isOpen = function () {
@@ -252,4 +556,25 @@
             return false;
         }
     };
+
+    /**
+     * Counters of the native admission control: the clients handed to
+     * javascript and the ones closed before that. Linux only.
+     * @return {clients, accepted, rejected, rejectedFilter, rejectedMaxClients, rejectedRate}
+     */
+    BluetoothSerialPortServer.prototype.getStats = function () {
+        if (!this.server) {
+            throw new Error("Not connected");
+        }
+
+        return this.server.getStats();
+    };
+
+    BluetoothSerialPortServer.prototype.getSocketInfo = function () {
+        if (!this.server) {
+            throw new Error("Not connected");
+        }
+
+        return this.server.getSocketInfo();
+    };
 }());
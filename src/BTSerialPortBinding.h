@@ -24,6 +24,12 @@
 #import "pipe.h"
 #endif
 
+#if !defined(__APPLE__) && !defined(_WIN32)
+#include <string>
+#include <vector>
+#include "BluetoothHelpers.h"
+#endif
+
 class BTSerialPortBinding : public Nan::ObjectWrap {
     private:
 #ifdef _WIN32
@@ -44,6 +50,17 @@ class BTSerialPortBinding : public Nan::ObjectWrap {
         static NAN_METHOD(Write);
         static NAN_METHOD(Close);
         static NAN_METHOD(Read);
+#if !defined(__APPLE__) && !defined(_WIN32)
+        static NAN_METHOD(GetSocketInfo);
+        static NAN_METHOD(FromFd);
+        static NAN_METHOD(Detach);
+        static NAN_METHOD(SendFd);
+        static NAN_METHOD(ReceiveFd);
+        static NAN_METHOD(SocketPair);
+        static NAN_METHOD(GetAdapters);
+        static NAN_METHOD(ChooseAdapter);
+        static NAN_METHOD(Broadcast);
+#endif
 
     private:
         struct connect_baton_t {
@@ -54,6 +71,9 @@ class BTSerialPortBinding : public Nan::ObjectWrap {
             char address[40];
             int status;
             int channelID;
+#if !defined(__APPLE__) && !defined(_WIN32)
+            char errorString[1024];
+#endif
         };
 
         struct read_baton_t {
@@ -63,19 +83,49 @@ class BTSerialPortBinding : public Nan::ObjectWrap {
             unsigned char result[1024];
             int errorno;
             int size;
+#if !defined(__APPLE__) && !defined(_WIN32)
+            bool timedOut;
+#endif
+        };
+
+#if !defined(__APPLE__) && !defined(_WIN32)
+        // One buffer written to many connections. The buffer is pinned once
+        // and the callback runs once, after the last connection is done.
+        struct broadcast_t {
+            Nan::Persistent<v8::Object> buffer;
+            Nan::Callback* callback;
+            int pending;
+            std::vector<long> written;          // bytes written per connection, -1 on error
+            std::vector<std::string> errors;
         };
+#endif
 
         struct write_baton_t {
             BTSerialPortBinding *rfcomm;
             char address[40];
             void* bufferData;
             int bufferLength;
+#if !defined(__APPLE__) && !defined(_WIN32)
+            int offset; // bytes already sent as part of a frame packed by the previous write
+            broadcast_t *broadcast; // set for broadcast writes, they have no buffer and callback of their own
+            int broadcastIndex;
+#endif
             Nan::Persistent<v8::Object> buffer;
             Nan::Callback* callback;
             size_t result;
             char errorString[1024];
         };
 
+#if !defined(__APPLE__) && !defined(_WIN32)
+        struct receive_fd_baton_t {
+            uv_work_t request;
+            Nan::Callback* cb;
+            int channel;
+            int fd;
+            int errorno;
+        };
+#endif
+
         struct queued_write_t {
             uv_work_t req;
             ngx_queue_t queue;
@@ -90,7 +140,25 @@ class BTSerialPortBinding : public Nan::ObjectWrap {
         SOCKET s;
 #else
         int s;
-        int rep[2];
+        control_channel_t mControl; // wakes a pending read on close() and detach()
+        socket_options_t options;
+        bool alignWrites;
+        int writeMtu;
+
+        uv_mutex_t mWriteQueueMutex;
+        ngx_queue_t mWriteQueue;
+        size_t mQueuedBytes; // only touched on the main thread
+        idle_timer_t mIdle;
+        std::string mKeepaliveData; // sent when the idle timer asks for a keepalive probe
+
+        static void QueueWrite(write_baton_t *baton);
+        static void FinishBroadcast(write_baton_t *data);
+        static void ReleaseBroadcast(broadcast_t *broadcast);
+        static void WriteAligned(write_baton_t *data, queued_write_t *queuedWrite);
+        static void OnIdleExpired(idle_timer_t *timer);
+        static void OnIdleProbe(idle_timer_t *timer);
+        static void EIO_ReceiveFd(uv_work_t *req);
+        static void EIO_AfterReceiveFd(uv_work_t *req);
 #endif
 #endif
 
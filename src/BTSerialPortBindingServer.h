@@ -16,9 +16,12 @@
 #include <uv.h>
 #include <nan.h>
 #include <memory>
+#include <string>
+#include <vector>
 #include "ngx-queue.h"
 #include <bluetooth/sdp.h>
 #include <bluetooth/sdp_lib.h>
+#include "BluetoothHelpers.h"
 
 class BTSerialPortBindingServer : public Nan::ObjectWrap {
     public:
@@ -27,56 +30,120 @@ class BTSerialPortBindingServer : public Nan::ObjectWrap {
         static NAN_METHOD(Close);
         static NAN_METHOD(Read);
         static NAN_METHOD(DisconnectClient);
+        static NAN_METHOD(DetachClient);
         static NAN_METHOD(IsOpen);
+        static NAN_METHOD(GetSocketInfo);
+        static NAN_METHOD(ReleaseClient);
+        static NAN_METHOD(GetStats);
 
     private:
 
         struct listen_baton_t {
             BTSerialPortBindingServer *rfcomm;
             uv_work_t request;
-            Nan::Callback* cb;
-            Nan::Callback* ecb;
+            std::unique_ptr<Nan::Callback> cb;
+            std::unique_ptr<Nan::Callback> ecb;
             char clientAddress[40];
             int status;
-            int listeningChannelID;
             char errorString[1024];
+            socket_options_t options;
+            int listenFd; // an inherited listening socket, -1 when we create our own
+            int backlog;  // > 0 accepts many clients at once and hands them over to javascript
+            char path[108]; // listen on this unix socket instead of RFCOMM, e.g. for testing
+            char sdpPath[108]; // register with a stand-in for the SDP daemon at this path
+        };
+
+        // A service is a (uuid, channel) pair with its own listening socket
+        // and SDP record. All services share the event loop and SDP session.
+        struct service_t {
+            BTSerialPortBindingServer *rfcomm;
+            std::string uuidString;
             uuid_t uuid;
+            int channel;
+            int s;              // the listening socket, 0 when closed
+            uv_poll_t *poll;
+            sdp_record_t *record;
         };
 
+        // The read and write batons hold a reference on the server for as
+        // long as they live. Deleting one releases everything it holds,
+        // whichever way the request ended.
         struct read_baton_t {
             BTSerialPortBindingServer *rfcomm;
             uv_work_t request;
-            Nan::Callback* cb;
+            std::unique_ptr<Nan::Callback> cb;
             unsigned char result[1024];
-            int errorno;
-            int size;
-            bool isDisconnect;
-            bool isClose;
+            int errorno = 0;
+            int size = 0;
+            bool isDisconnect = false;
+            bool isClose = false;
+            bool isTimeout = false;
+
+            read_baton_t(BTSerialPortBindingServer *server, v8::Local<v8::Function> callback) :
+                rfcomm(server), cb(new Nan::Callback(callback)) {
+                request.data = this;
+                rfcomm->Ref();
+            }
+            ~read_baton_t() { rfcomm->Unref(); }
         };
 
         struct write_baton_t {
             BTSerialPortBindingServer *rfcomm;
-            char address[40];
             void* bufferData;
             size_t bufferLength;
             Nan::Persistent<v8::Object> buffer;
-            Nan::Callback* callback;
-            size_t result;
-            char errorString[1024];
+            std::unique_ptr<Nan::Callback> callback;
+            size_t result = 0;
+            char errorString[1024] = { 0 };
+
+            write_baton_t(BTSerialPortBindingServer *server, v8::Local<v8::Object> bufferObject, v8::Local<v8::Function> cb) :
+                rfcomm(server), bufferData(node::Buffer::Data(bufferObject)),
+                bufferLength(node::Buffer::Length(bufferObject)), callback(new Nan::Callback(cb)) {
+                buffer.Reset(bufferObject);
+                rfcomm->Ref();
+            }
+            ~write_baton_t() {
+                buffer.Reset();
+                rfcomm->Unref();
+            }
         };
 
         struct queued_write_t {
             uv_work_t req;
             ngx_queue_t queue;
-            write_baton_t* baton;
+            std::unique_ptr<write_baton_t> baton;
+        };
+
+        // Decides which clients get through before javascript sees them,
+        // everybody else is closed right after accept()
+        struct admission_t {
+            int maxClients = 0;             // multi-client mode, 0 for no limit
+            double rate = 0;                // clients accepted per second, 0 for no limit
+            double burst = 0;               // clients accepted at once after a quiet period
+            double tokens = 0;
+            uint64_t refilled = 0;          // uv_hrtime() of the last refill
+            std::vector<std::string> allow; // empty lets every address through
+            std::vector<std::string> deny;
+            int clients = 0;                // handed to javascript and not released yet
+            uint64_t accepted = 0;
+            uint64_t rejectedFilter = 0;
+            uint64_t rejectedMaxClients = 0;
+            uint64_t rejectedRate = 0;
         };
 
-        int s;
-        int rep[2];
+        idle_timer_t mIdle;         // the single client, multi-client connections have their own
+        std::string mKeepaliveData;
+
+        control_channel_t mControl; // wakes a pending read on close() and disconnectClient()
         int mClientSocket = 0;
+        bool mDetaching = false;    // detachClient() left a disconnect for the reader to pick up
 
         listen_baton_t * mListenBaton = nullptr;
+        bool mListenPending = false; // the listen worker owns the sockets and the SDP session
+        bool mClosed = false;
+        admission_t mAdmission;
         sdp_session_t * mSdpSession = nullptr;
+        std::vector<service_t *> mServices;
 
         uv_mutex_t mWriteQueueMutex;
         ngx_queue_t mWriteQueue;
@@ -87,27 +154,24 @@ class BTSerialPortBindingServer : public Nan::ObjectWrap {
 
         static NAN_METHOD(New);
         static void EIO_Listen(uv_work_t *req);
+        static void ListenSocket(listen_baton_t *baton, service_t *service);
         static void EIO_AfterListen(uv_work_t *req);
         static void EIO_Write(uv_work_t *req);
         static void EIO_AfterWrite(uv_work_t *req);
         static void EIO_Read(uv_work_t *req);
         static void EIO_AfterRead(uv_work_t *req);
 
-        void AdvertiseAndAccept();
         void Advertise();
+        void ReleaseServices();
+        void Accept();
+        void PauseAccepting();
+        void StopAccepting();
+        bool IsListening();
+        bool Admit(const char *address);
+        static void OnAcceptable(uv_poll_t *handle, int status, int events);
+        static void OnIdleExpired(idle_timer_t *timer);
+        static void OnIdleProbe(idle_timer_t *timer);
         void CloseClientSocket();
-
-
-        class ClientWorker : public Nan::AsyncWorker {
-            public:
-                ClientWorker(Nan::Callback *cb, listen_baton_t *baton);
-                ~ClientWorker();
-                void Execute() override;
-                void HandleOKCallback() override;
-            private:
-                listen_baton_t * mBaton;
-
-        };
 };
 
 #endif
@@ -20,6 +20,13 @@
 #import <Foundation/NSArray.h>
 #endif
 
+#if !defined(__APPLE__) && !defined(_WIN32)
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#endif
+
 struct bt_device {
     char address[19];
     char name[248];
@@ -32,6 +39,71 @@ struct bt_inquiry {
 };
 #endif
 
+#if !defined(__APPLE__) && !defined(_WIN32)
+// How an inquiry is run and the names of the found devices are read
+struct inquiry_options_t {
+    int nameConcurrency;    // remote name requests outstanding on the controller at once
+    int nameTimeout;        // ms before a remote name request is given up
+    int hciSocket;          // talk HCI over this descriptor instead of the adapter, -1 for the adapter
+    int length;             // inquiry length in units of 1.28 s
+    int maxResponses;       // the controller ends the inquiry after this many devices, 0 for no limit
+    int lap;                // access code the devices answer to, INQUIRY_GIAC or INQUIRY_LIAC
+    bool flushCache;        // run a new inquiry rather than take the kernel's recent results
+    int cacheTtl;           // ms a cached name is taken instead of asking the device, 0 to always ask
+    std::string cacheFile;  // where the device cache is kept between runs, empty for nowhere
+    std::vector<int> adapters;  // HCI device ids to inquire on at once, empty for the default adapter
+    bool allAdapters;       // inquire on every adapter that is up, instead of `adapters`
+};
+
+#define NAME_DEFAULT_CONCURRENCY 4
+#define NAME_DEFAULT_TIMEOUT 5000
+
+// Inquiry length in units of 1.28 s, the General and Limited Inquiry
+// Access Codes. Devices in limited discoverable mode answer both.
+#define INQUIRY_DEFAULT_LENGTH 8
+#define INQUIRY_MAX_LENGTH 0x30
+#define INQUIRY_GIAC 0x9e8b33
+#define INQUIRY_LIAC 0x9e8b00
+
+#define EIR_MAX_UUIDS 32
+
+// What a device tells about itself in its Extended Inquiry Response
+struct eir_data_t {
+    char name[249];
+    bool nameComplete;                  // false when the device sent a shortened name
+    bool hasTxPower;
+    int8_t txPower;                     // dBm
+    int uuidCount;
+    char uuids[EIR_MAX_UUIDS][37];      // service class UUIDs, all in their 128 bit form
+};
+
+#define INQUIRY_NO_RSSI 127
+
+// A device as an inquiry reports it
+struct inquiry_result_t {
+    bt_device device;
+    char adapter[19];                   // the adapter that heard the device best, empty for a stand-in socket
+    int rssi;                           // dBm, INQUIRY_NO_RSSI when the controller did not measure it
+    int deviceClass;
+    bool hasEir;
+    eir_data_t eir;
+};
+
+// A service a device offers, as one SDP record describes it
+struct service_record_t {
+    uint32_t handle;
+    std::string name;                   // empty when the record has none
+    std::vector<std::string> uuids;     // service class UUIDs, all in their 128 bit form
+    int channel;                        // RFCOMM channel, -1 for none
+    int psm;                            // L2CAP PSM, -1 for none
+};
+
+struct control_channel_t;
+class InquireWorker;
+class DiscoveryWorker;
+class ServiceWorker;
+#endif
+
 class DeviceINQ : public Nan::ObjectWrap {
     private:
 #ifdef _WIN32
@@ -51,17 +123,42 @@ class DeviceINQ : public Nan::ObjectWrap {
         static void EIO_AfterSdpSearch(uv_work_t *req);
 #ifdef __APPLE__
         static NSArray *doInquire();
-#else
+#elif defined(_WIN32)
         static bt_inquiry doInquire();
+#else
+        static int doInquire(const inquiry_options_t &options, const std::function<void(const inquiry_result_t &)> &found,
+                control_channel_t *control = NULL);
+        static bool parseEir(const uint8_t *data, int length, eir_data_t *eir);
+        static int parseServiceRecord(const uint8_t *data, int length, service_record_t *record);
+        static int parseServiceRecords(const uint8_t *data, int length, std::vector<service_record_t> *records);
 #endif
 
     private:
+#if !defined(__APPLE__) && !defined(_WIN32)
+        friend class InquireWorker;
+        friend class DiscoveryWorker;
+        friend class ServiceWorker;
+        DiscoveryWorker *discovery;     // the continuous discovery running on this object, if any
+
+        // inquiries and searches that can still be cancelled, by the id handed to JS
+        std::map<int, control_channel_t *> operations;
+        int nextOperation;
+
+        int StartOperation(control_channel_t *control);
+        void EndOperation(int id);
+#endif
+
         struct sdp_baton_t {
             DeviceINQ *inquire;
             uv_work_t request;
             Nan::Callback* cb;
             int channelID;
             char address[40];
+#if !defined(__APPLE__) && !defined(_WIN32)
+            control_channel_t *control;
+            int operation;
+            bool cancelled;
+#endif
         };
 
         DeviceINQ();
@@ -72,6 +169,14 @@ class DeviceINQ : public Nan::ObjectWrap {
         static NAN_METHOD(InquireSync);
         static NAN_METHOD(SdpSearch);
         static NAN_METHOD(ListPairedDevices);
+#if !defined(__APPLE__) && !defined(_WIN32)
+        static NAN_METHOD(ParseEir);
+        static NAN_METHOD(Discover);
+        static NAN_METHOD(StopDiscovery);
+        static NAN_METHOD(Cancel);
+        static NAN_METHOD(DiscoverServices);
+        static NAN_METHOD(ParseServiceRecords);
+#endif
 
 };
 
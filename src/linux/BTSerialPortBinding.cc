@@ -16,6 +16,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
 #include "BTSerialPortBinding.h"
 
 extern "C"{
@@ -30,6 +33,7 @@ extern "C"{
     #include <sys/ioctl.h>
     #include <sys/socket.h>
     #include <sys/types.h>
+    #include <sys/uio.h>
     #include <assert.h>
 
 
@@ -45,8 +49,8 @@ using namespace std;
 using namespace node;
 using namespace v8;
 
-static uv_mutex_t write_queue_mutex;
-static ngx_queue_t write_queue;
+// Upper bound on the number of queued writes packed into a single frame
+#define MAX_PACKED_WRITES 16
 
 void BTSerialPortBinding::EIO_Connect(uv_work_t *req) {
     connect_baton_t *baton = static_cast<connect_baton_t *>(req->data);
@@ -60,6 +64,35 @@ void BTSerialPortBinding::EIO_Connect(uv_work_t *req) {
     // allocate a socket
     baton->rfcomm->s = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
 
+    // buffer sizes, priority and link mode need to be in place before connecting
+    if (BluetoothHelpers::ApplySocketOptions(baton->rfcomm->s, &baton->rfcomm->options) < 0) {
+        baton->status = -1;
+        sprintf(baton->errorString, "Cannot set socket options: %s", strerror(errno));
+        return;
+    }
+
+    // without a bound source address the kernel routes every link over the first adapter
+    int adapter = baton->rfcomm->options.adapter;
+    if (adapter == ADAPTER_AUTO) {
+        std::vector<adapter_stats_t> adapters;
+        int chosen = -1;
+        if (BluetoothHelpers::GetAdapterStats(adapters) == 0) {
+            chosen = BluetoothHelpers::ChooseAdapter(adapters);
+        }
+        if (chosen < 0) {
+            baton->status = -1;
+            sprintf(baton->errorString, "Cannot connect: no adapter with a free link");
+            return;
+        }
+        adapter = adapters[chosen].devId;
+    }
+
+    if (adapter != ADAPTER_ANY && BluetoothHelpers::BindAdapter(baton->rfcomm->s, adapter) < 0) {
+        baton->status = -1;
+        sprintf(baton->errorString, "Cannot bind to adapter hci%d: %s", adapter, strerror(errno));
+        return;
+    }
+
     // set the connection parameters (who to connect to)
     addr.rc_family = AF_BLUETOOTH;
     addr.rc_channel = (uint8_t) baton->channelID;
@@ -68,6 +101,13 @@ void BTSerialPortBinding::EIO_Connect(uv_work_t *req) {
     // connect to server
     baton->status = connect(baton->rfcomm->s, (struct sockaddr *)&addr, sizeof(addr));
 
+    // the frame size is read once, aligned writes use it for the lifetime of the connection
+    socket_info_t socketInfo;
+    if (baton->status == 0 && baton->rfcomm->alignWrites &&
+        BluetoothHelpers::GetSocketInfo(baton->rfcomm->s, &baton->rfcomm->options, &socketInfo) == 0) {
+        baton->rfcomm->writeMtu = socketInfo.mtu > 0 ? socketInfo.mtu : RFCOMM_DEFAULT_MTU;
+    }
+
     int sock_flags = fcntl(baton->rfcomm->s, F_GETFL, 0);
     fcntl(baton->rfcomm->s, F_SETFL, sock_flags | O_NONBLOCK);
 }
@@ -81,12 +121,13 @@ void BTSerialPortBinding::EIO_AfterConnect(uv_work_t *req) {
 
     Nan::AsyncResource resource("bluetooth-serial-port:Connect");
     if (baton->status == 0) {
+        BluetoothHelpers::StartIdleTimer(&baton->rfcomm->mIdle, &baton->rfcomm->options);
         baton->cb->Call(0, NULL, &resource);
     } else {
         char msg[80];
         sprintf(msg, "Cannot connect: %d", baton->status);
         Local<Value> argv[] = {
-            Nan::Error(msg)
+            Nan::Error(baton->errorString[0] ? baton->errorString : msg)
         };
         baton->ecb->Call(1, argv, &resource);
     }
@@ -110,50 +151,130 @@ void BTSerialPortBinding::EIO_Write(uv_work_t *req) {
     int bytesToSend = data->bufferLength;
     data->result = 0;
 
-    if (rfcomm->s != 0) {
+    if (rfcomm->s == 0) {
+        sprintf(data->errorString, "Attempting to write to a closed connection");
+    } else if (rfcomm->alignWrites) {
+        WriteAligned(data, queuedWrite);
+    } else {
         do {
-            int bytesSent = write(rfcomm->s, data->bufferData+data->result, bytesToSend);
+            int bytesSent = write(rfcomm->s, (char *)data->bufferData+data->result, bytesToSend);
             if (bytesSent >= 0) {
                 bytesToSend -= bytesSent;
                 data->result += bytesSent;
-            } else {
+            } else if (errno != EAGAIN || !BluetoothHelpers::WaitWritable(rfcomm->s)) {
                 sprintf(data->errorString, "Writing attempt was unsuccessful");
                 break;
             }
         } while (bytesToSend > 0);
-    } else {
-        sprintf(data->errorString, "Attempting to write to a closed connection");
     }
 }
 
+// Sends the buffer in whole frames. A tail shorter than the MTU is topped up
+// with data of the writes queued behind it, so the radio only sends a short
+// frame when the queue runs dry. Bytes taken from the next writes are recorded
+// in their offset and skipped when it is their turn.
+void BTSerialPortBinding::WriteAligned(write_baton_t *data, queued_write_t *queuedWrite) {
+    BTSerialPortBinding* rfcomm = data->rfcomm;
+    int mtu = rfcomm->writeMtu;
+    char *buffer = (char *)data->bufferData;
+
+    while (data->offset < data->bufferLength) {
+        int remaining = data->bufferLength - data->offset;
+        ssize_t bytesSent;
+
+        if (remaining >= mtu) {
+            // the kernel cuts a multiple of the MTU into full frames
+            bytesSent = write(rfcomm->s, buffer + data->offset, remaining - remaining % mtu);
+            if (bytesSent > 0) {
+                data->offset += bytesSent;
+            }
+        } else {
+            struct iovec iov[MAX_PACKED_WRITES];
+            write_baton_t *packed[MAX_PACKED_WRITES];
+            int count = 1;
+            int total = remaining;
+
+            iov[0].iov_base = buffer + data->offset;
+            iov[0].iov_len = remaining;
+            packed[0] = data;
+
+            // writes behind us are only appended by the main thread and only
+            // removed after we are done, so they are safe to read under the lock
+            uv_mutex_lock(&rfcomm->mWriteQueueMutex);
+            for (ngx_queue_t *q = ngx_queue_next(&queuedWrite->queue);
+                 q != ngx_queue_sentinel(&rfcomm->mWriteQueue) && total < mtu && count < MAX_PACKED_WRITES;
+                 q = ngx_queue_next(q)) {
+                queued_write_t *nextQueuedWrite = ngx_queue_data(q, queued_write_t, queue);
+                write_baton_t *next = nextQueuedWrite->baton;
+                int take = next->bufferLength - next->offset;
+                if (take > mtu - total) {
+                    take = mtu - total;
+                }
+                if (take <= 0) {
+                    continue;
+                }
+
+                iov[count].iov_base = (char *)next->bufferData + next->offset;
+                iov[count].iov_len = take;
+                packed[count++] = next;
+                total += take;
+            }
+            uv_mutex_unlock(&rfcomm->mWriteQueueMutex);
+
+            bytesSent = writev(rfcomm->s, iov, count);
+
+            // account a (partial) write against the buffers in queue order
+            ssize_t left = bytesSent;
+            for (int i = 0; i < count && left > 0; i++) {
+                int n = (left < (ssize_t)iov[i].iov_len) ? left : iov[i].iov_len;
+                packed[i]->offset += n;
+                left -= n;
+            }
+        }
+
+        if (bytesSent < 0 && (errno != EAGAIN || !BluetoothHelpers::WaitWritable(rfcomm->s))) {
+            sprintf(data->errorString, "Writing attempt was unsuccessful");
+            break;
+        }
+    }
+
+    data->result = data->offset;
+}
+
 void BTSerialPortBinding::EIO_AfterWrite(uv_work_t *req) {
     Nan::HandleScope scope;
 
     queued_write_t *queuedWrite = static_cast<queued_write_t*>(req->data);
     write_baton_t *data = static_cast<write_baton_t*>(queuedWrite->baton);
 
-    Local<Value> argv[2];
-    if (data->errorString[0]) {
-        argv[0] = Nan::Error(data->errorString);
-        argv[1] = Nan::Undefined();
+    data->rfcomm->mQueuedBytes -= data->bufferLength;
+
+    if (data->broadcast) {
+        FinishBroadcast(data);
     } else {
-        argv[0] = Nan::Undefined();
-        argv[1] = Nan::New<v8::Integer>((int32_t)data->result);
-    }
+        Local<Value> argv[2];
+        if (data->errorString[0]) {
+            argv[0] = Nan::Error(data->errorString);
+            argv[1] = Nan::Undefined();
+        } else {
+            argv[0] = Nan::Undefined();
+            argv[1] = Nan::New<v8::Integer>((int32_t)data->result);
+        }
 
-    Nan::AsyncResource resource("bluetooth-serial-port:Write");
-    data->callback->Call(2, argv, &resource);
+        Nan::AsyncResource resource("bluetooth-serial-port:Write");
+        data->callback->Call(2, argv, &resource);
+    }
 
-    uv_mutex_lock(&write_queue_mutex);
+    uv_mutex_lock(&data->rfcomm->mWriteQueueMutex);
     ngx_queue_remove(&queuedWrite->queue);
 
-    if (!ngx_queue_empty(&write_queue)) {
+    if (!ngx_queue_empty(&data->rfcomm->mWriteQueue)) {
         // Always pull the next work item from the head of the queue
-        ngx_queue_t* head = ngx_queue_head(&write_queue);
+        ngx_queue_t* head = ngx_queue_head(&data->rfcomm->mWriteQueue);
         queued_write_t* nextQueuedWrite = ngx_queue_data(head, queued_write_t, queue);
         uv_queue_work(uv_default_loop(), &nextQueuedWrite->req, EIO_Write, (uv_after_work_cb)EIO_AfterWrite);
     }
-    uv_mutex_unlock(&write_queue_mutex);
+    uv_mutex_unlock(&data->rfcomm->mWriteQueueMutex);
 
     data->buffer.Reset();
     delete data->callback;
@@ -162,32 +283,120 @@ void BTSerialPortBinding::EIO_AfterWrite(uv_work_t *req) {
     delete queuedWrite;
 }
 
+// Records the result of one connection of a broadcast
+void BTSerialPortBinding::FinishBroadcast(write_baton_t *data) {
+    broadcast_t *broadcast = data->broadcast;
+
+    if (data->errorString[0]) {
+        broadcast->written[data->broadcastIndex] = -1;
+        broadcast->errors[data->broadcastIndex] = data->errorString;
+    } else {
+        broadcast->written[data->broadcastIndex] = data->result;
+    }
+
+    ReleaseBroadcast(broadcast);
+}
+
+// The last one to release the broadcast reports all results and unpins the buffer
+void BTSerialPortBinding::ReleaseBroadcast(broadcast_t *broadcast) {
+    if (--broadcast->pending > 0) {
+        return;
+    }
+
+    Local<Array> results = Nan::New<Array>(broadcast->written.size());
+    for (size_t i = 0; i < broadcast->written.size(); i++) {
+        if (broadcast->written[i] < 0) {
+            Nan::Set(results, i, Nan::Error(broadcast->errors[i].c_str()));
+        } else {
+            Nan::Set(results, i, Nan::New<v8::Number>(broadcast->written[i]));
+        }
+    }
+
+    Local<Value> argv[] = {
+        results
+    };
+    Nan::AsyncResource resource("bluetooth-serial-port:Broadcast");
+    broadcast->callback->Call(1, argv, &resource);
+
+    broadcast->buffer.Reset();
+    delete broadcast->callback;
+    delete broadcast;
+}
+
+// Called by the idle timer wheel when nothing came in for idleTimeout. The
+// pending read reports the timeout, javascript closes the connection.
+void BTSerialPortBinding::OnIdleExpired(idle_timer_t *timer) {
+    BTSerialPortBinding *rfcomm = static_cast<BTSerialPortBinding *>(timer->data);
+
+    if (rfcomm->s != 0) {
+        BluetoothHelpers::SignalControl(&rfcomm->mControl, CONTROL_TIMEOUT);
+        shutdown(rfcomm->s, SHUT_RDWR);
+    }
+}
+
+void BTSerialPortBinding::OnIdleProbe(idle_timer_t *timer) {
+    BTSerialPortBinding *rfcomm = static_cast<BTSerialPortBinding *>(timer->data);
+
+    // only on an idle write queue, a probe must not end up in the middle of
+    // a write that is in progress. Outgoing data makes a probe pointless anyway.
+    uv_mutex_lock(&rfcomm->mWriteQueueMutex);
+    if (rfcomm->s != 0 && ngx_queue_empty(&rfcomm->mWriteQueue)) {
+        send(rfcomm->s, rfcomm->mKeepaliveData.data(), rfcomm->mKeepaliveData.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    uv_mutex_unlock(&rfcomm->mWriteQueueMutex);
+}
+
 void BTSerialPortBinding::EIO_Read(uv_work_t *req) {
     unsigned char buf[1024]= { 0 };
 
     read_baton_t *baton = static_cast<read_baton_t *>(req->data);
 
+    // close() and detach() reset the socket from the main thread, work on a copy
+    int s = baton->rfcomm->s;
+    int control = baton->rfcomm->mControl.fd;
+
     memset(buf, 0, sizeof(buf));
 
-    fd_set set;
-    FD_ZERO(&set);
-    FD_SET(baton->rfcomm->s, &set);
-    FD_SET(baton->rfcomm->rep[0], &set);
+    int nfds = (s > control) ? s : control;
+
+    bool retry;
+    do {
+        retry = false;
+
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(control, &set);
+        if (s != 0) {
+            FD_SET(s, &set);
+        }
 
-    int nfds = (baton->rfcomm->s > baton->rfcomm->rep[0]) ? baton->rfcomm->s : baton->rfcomm->rep[0];
+        if (pselect(nfds + 1, &set, NULL, NULL, NULL, NULL) < 0) {
+            retry = (errno == EINTR);
+            continue;
+        }
 
-    if (pselect(nfds + 1, &set, NULL, NULL, NULL, NULL) >= 0) {
-        if (FD_ISSET(baton->rfcomm->s, &set)) {
-            baton->size = read(baton->rfcomm->s, buf, sizeof(buf));
+        // a close or detach request wins from pending data, after detach()
+        // the socket belongs to somebody else
+        if (FD_ISSET(control, &set)) {
+            int commands = BluetoothHelpers::TakeControl(&baton->rfcomm->mControl);
+            baton->timedOut = (commands & CONTROL_TIMEOUT) != 0;
+            baton->size = 0;
+            // a wake-up without commands was left behind by an earlier signal
+            retry = (commands == 0);
+        } else if (s != 0 && FD_ISSET(s, &set)) {
+            baton->size = read(s, buf, sizeof(buf));
+            if (baton->size > 0) {
+                BluetoothHelpers::TouchIdleTimer(&baton->rfcomm->mIdle);
+            }
         } else {
             // when no data is read from rfcomm the connection has been closed.
             baton->size = 0;
         }
+    } while (retry);
 
-        // determine if we read anything that we can copy.
-        if (baton->size > 0) {
-            memcpy(baton->result, buf, baton->size);
-        }
+    // determine if we read anything that we can copy.
+    if (baton->size > 0) {
+        memcpy(baton->result, buf, baton->size);
     }
 }
 
@@ -200,7 +409,10 @@ void BTSerialPortBinding::EIO_AfterRead(uv_work_t *req) {
 
     Local<Value> argv[2];
 
-    if (baton->size < 0) {
+    if (baton->timedOut) {
+        argv[0] = Nan::Error("Idle timeout");
+        argv[1] = Nan::Undefined();
+    } else if (baton->size < 0) {
         argv[0] = Nan::Error("Error reading from connection");
         argv[1] = Nan::Undefined();
     } else {
@@ -225,10 +437,13 @@ void BTSerialPortBinding::EIO_AfterRead(uv_work_t *req) {
     baton = NULL;
 }
 
+Nan::Persistent<FunctionTemplate> BTSerialPortBinding::s_ct;
+
 void BTSerialPortBinding::Init(Local<Object> target) {
     Nan::HandleScope scope;
 
     Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+    s_ct.Reset(t);
 
     t->InstanceTemplate()->SetInternalFieldCount(1);
     t->SetClassName(Nan::New("BTSerialPortBinding").ToLocalChecked());
@@ -239,48 +454,141 @@ void BTSerialPortBinding::Init(Local<Object> target) {
     Nan::SetPrototypeMethod(t, "write", Write);
     Nan::SetPrototypeMethod(t, "read", Read);
     Nan::SetPrototypeMethod(t, "close", Close);
+    Nan::SetPrototypeMethod(t, "getSocketInfo", GetSocketInfo);
+    Nan::SetPrototypeMethod(t, "detach", Detach);
+    Nan::SetMethod(t, "fromFd", FromFd);
+    Nan::SetMethod(t, "sendFd", SendFd);
+    Nan::SetMethod(t, "receiveFd", ReceiveFd);
+    Nan::SetMethod(t, "socketPair", SocketPair);
+    Nan::SetMethod(t, "getAdapters", GetAdapters);
+    Nan::SetMethod(t, "chooseAdapter", ChooseAdapter);
+    Nan::SetMethod(t, "broadcast", Broadcast);
     Nan::Set(target, Nan::New("BTSerialPortBinding").ToLocalChecked(), t->GetFunction(ctx).ToLocalChecked());
 }
 
 BTSerialPortBinding::BTSerialPortBinding() :
-    s(0) {
+    s(0), alignWrites(false), mQueuedBytes(0) {
+    mControl.fd = -1;
+    mControl.commands = 0;
+    BluetoothHelpers::InitSocketOptions(&options);
+    writeMtu = options.mtu;
+    uv_mutex_init(&mWriteQueueMutex);
+    ngx_queue_init(&mWriteQueue);
+    BluetoothHelpers::InitIdleTimer(&mIdle, this, OnIdleExpired, OnIdleProbe);
 }
 
 BTSerialPortBinding::~BTSerialPortBinding() {
-
+    BluetoothHelpers::StopIdleTimer(&mIdle);
+    // not before now, a pending read may still be waiting on it
+    BluetoothHelpers::CloseControl(&mControl);
+    uv_mutex_destroy(&mWriteQueueMutex);
 }
 
 NAN_METHOD(BTSerialPortBinding::New) {
-    uv_mutex_init(&write_queue_mutex);
-    ngx_queue_init(&write_queue);
+    const char *usage = "usage: BTSerialPortBinding(address, channelID, callback, error[, options])";
 
-    const char *usage = "usage: BTSerialPortBinding(address, channelID, callback, error)";
-    if (info.Length() != 4) {
+    // BTSerialPortBinding(fd[, options]) is how fromFd() adopts a connected socket
+    bool adopt = (info.Length() == 1 || info.Length() == 2) && info[0]->IsNumber();
+    if (!adopt && info.Length() != 4 && info.Length() != 5) {
         return Nan::ThrowError(usage);
     }
 
-    String::Utf8Value address(info.GetIsolate(), info[0]);
+    int optionsIndex = adopt ? 1 : 4;
+    std::map<std::string, std::string> options;
+    std::string keepaliveData;
+    if (info.Length() > optionsIndex && info[optionsIndex]->IsObject()) {
+        Local<Object> jsOptions = Local<Object>::Cast(info[optionsIndex]);
+        Isolate *isolate = jsOptions->GetIsolate();
+        Local<Context> ctx = isolate->GetCurrentContext();
+
+        // the probe is binary, it can't go through the string map
+        Local<Value> jsKeepaliveData = Nan::Get(jsOptions, Nan::New("keepaliveData").ToLocalChecked()).ToLocalChecked();
+        if (Buffer::HasInstance(jsKeepaliveData)) {
+            keepaliveData.assign(Buffer::Data(jsKeepaliveData), Buffer::Length(jsKeepaliveData));
+        } else if (jsKeepaliveData->IsString()) {
+            keepaliveData = *String::Utf8Value(isolate, jsKeepaliveData);
+        }
+
+        Local<Array> properties = jsOptions->GetPropertyNames(ctx).ToLocalChecked();
+        for (uint32_t i = 0; i < properties->Length(); i++) {
+            Local<Value> property = Nan::Get(properties, i).ToLocalChecked();
+            Local<Value> optionValue = Nan::Get(jsOptions, property).ToLocalChecked();
+            options[*String::Utf8Value(isolate, property)] = *String::Utf8Value(isolate, optionValue);
+        }
+    }
+
+    int channelID = 0;
+    int fd = -1;
+    if (adopt) {
+        fd = info[0]->Int32Value(Nan::GetCurrentContext()).ToChecked();
 
-    int channelID = info[1]->Int32Value(Nan::GetCurrentContext()).ToChecked();
-    if (channelID <= 0) {
-        return Nan::ThrowTypeError("ChannelID should be a positive int value.");
+        struct sockaddr_storage peer;
+        socklen_t peerLen = sizeof(peer);
+        if (fd < 0 || getpeername(fd, (struct sockaddr *)&peer, &peerLen) < 0) {
+            return Nan::ThrowTypeError("fd should be a connected socket.");
+        }
+    } else {
+        channelID = info[1]->Int32Value(Nan::GetCurrentContext()).ToChecked();
+        if (channelID <= 0) {
+            return Nan::ThrowTypeError("ChannelID should be a positive int value.");
+        }
     }
 
     BTSerialPortBinding* rfcomm = new BTSerialPortBinding();
+
+    std::string error;
+    if (!BluetoothHelpers::ParseSocketOptions(options, &rfcomm->options, error)) {
+        delete rfcomm;
+        return Nan::ThrowTypeError(error.c_str());
+    }
+
+    if (options.count("writeMode") && options["writeMode"] != "undefined") {
+        if (options["writeMode"] != "mtu" && options["writeMode"] != "default") {
+            delete rfcomm;
+            return Nan::ThrowTypeError("Option writeMode should be either 'default' or 'mtu'.");
+        }
+        rfcomm->alignWrites = (options["writeMode"] == "mtu");
+    }
+    rfcomm->writeMtu = rfcomm->options.mtu > 0 ? rfcomm->options.mtu : RFCOMM_DEFAULT_MTU;
+
+    if (rfcomm->options.keepaliveInterval > 0 && keepaliveData.empty()) {
+        delete rfcomm;
+        return Nan::ThrowTypeError("Option keepaliveInterval needs the keepaliveData to send.");
+    }
+    rfcomm->mKeepaliveData = keepaliveData;
+
     rfcomm->Wrap(info.This());
 
-    connect_baton_t *baton = new connect_baton_t();
-    baton->rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBinding>(info.This());
-    baton->channelID = channelID;
+    // allocate the channel that wakes up pending reads
+    if (BluetoothHelpers::OpenControl(&rfcomm->mControl) < 0) {
+        return Nan::ThrowError("Cannot create control channel for reading.");
+    }
+
+    if (adopt) {
+        // the socket is already connected, the link mode can no longer be changed
+        socket_options_t adoptOptions = rfcomm->options;
+        adoptOptions.linkMode = -1;
+        BluetoothHelpers::ApplySocketOptions(fd, &adoptOptions);
 
-    // allocate an error pipe
-    if (pipe(baton->rfcomm->rep) == -1) {
-        Nan::ThrowError("Cannot create pipe for reading.");
+        int sock_flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, sock_flags | O_NONBLOCK);
+
+        socket_info_t socketInfo;
+        if (rfcomm->alignWrites && BluetoothHelpers::GetSocketInfo(fd, &rfcomm->options, &socketInfo) == 0) {
+            rfcomm->writeMtu = socketInfo.mtu > 0 ? socketInfo.mtu : RFCOMM_DEFAULT_MTU;
+        }
+
+        rfcomm->s = fd;
+        BluetoothHelpers::StartIdleTimer(&rfcomm->mIdle, &rfcomm->options);
+        info.GetReturnValue().Set(info.This());
+        return;
     }
 
-    int flags = fcntl(baton->rfcomm->rep[0], F_GETFL, 0);
-    fcntl(baton->rfcomm->rep[0], F_SETFL, flags | O_NONBLOCK);
+    String::Utf8Value address(info.GetIsolate(), info[0]);
 
+    connect_baton_t *baton = new connect_baton_t();
+    baton->rfcomm = rfcomm;
+    baton->channelID = channelID;
     strcpy(baton->address, *address);
     baton->cb = new Nan::Callback(info[2].As<Function>());
     baton->ecb = new Nan::Callback(info[3].As<Function>());
@@ -292,6 +600,24 @@ NAN_METHOD(BTSerialPortBinding::New) {
     info.GetReturnValue().Set(info.This());
 }
 
+NAN_METHOD(BTSerialPortBinding::FromFd) {
+    const char *usage = "usage: BTSerialPortBinding.fromFd(fd[, options])";
+    if (info.Length() < 1 || info.Length() > 2 || !info[0]->IsNumber()) {
+        return Nan::ThrowError(usage);
+    }
+
+    Local<Value> argv[] = {
+        info[0],
+        info.Length() == 2 ? info[1] : Local<Value>(Nan::New<Object>())
+    };
+
+    Local<Function> cons = Nan::GetFunction(Nan::New(s_ct)).ToLocalChecked();
+    Nan::MaybeLocal<Object> instance = Nan::NewInstance(cons, 2, argv);
+    if (!instance.IsEmpty()) {
+        info.GetReturnValue().Set(instance.ToLocalChecked());
+    }
+}
+
 NAN_METHOD(BTSerialPortBinding::Write) {
     // usage
     if (info.Length() != 3) {
@@ -320,7 +646,6 @@ NAN_METHOD(BTSerialPortBinding::Write) {
     }
 
     write_baton_t *baton = new write_baton_t();
-    memset(baton, 0, sizeof(write_baton_t));
     baton->rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBinding>(info.This());
     baton->rfcomm->Ref();
     baton->buffer.Reset(bufferObject);
@@ -328,22 +653,26 @@ NAN_METHOD(BTSerialPortBinding::Write) {
     baton->bufferLength = bufferLength;
     baton->callback = new Nan::Callback(info[2].As<Function>());
 
+    QueueWrite(baton);
+}
+
+void BTSerialPortBinding::QueueWrite(write_baton_t *baton) {
     queued_write_t *queuedWrite = new queued_write_t();
     memset(queuedWrite, 0, sizeof(queued_write_t));
     queuedWrite->baton = baton;
     queuedWrite->req.data = queuedWrite;
 
-    uv_mutex_lock(&write_queue_mutex);
-    bool empty = ngx_queue_empty(&write_queue);
+    baton->rfcomm->mQueuedBytes += baton->bufferLength;
 
-    ngx_queue_insert_tail(&write_queue, &queuedWrite->queue);
+    uv_mutex_lock(&baton->rfcomm->mWriteQueueMutex);
+    bool empty = ngx_queue_empty(&baton->rfcomm->mWriteQueue);
+
+    ngx_queue_insert_tail(&baton->rfcomm->mWriteQueue, &queuedWrite->queue);
 
     if (empty) {
         uv_queue_work(uv_default_loop(), &queuedWrite->req, EIO_Write, (uv_after_work_cb)EIO_AfterWrite);
     }
-    uv_mutex_unlock(&write_queue_mutex);
-
-    return;
+    uv_mutex_unlock(&baton->rfcomm->mWriteQueueMutex);
 }
 
 NAN_METHOD(BTSerialPortBinding::Close) {
@@ -357,17 +686,15 @@ NAN_METHOD(BTSerialPortBinding::Close) {
 
     BTSerialPortBinding* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBinding>(info.This());
 
+    BluetoothHelpers::StopIdleTimer(&rfcomm->mIdle);
+
     if (rfcomm->s != 0) {
         shutdown(rfcomm->s, SHUT_RDWR);
         close(rfcomm->s);
-        write(rfcomm->rep[1], "close", (strlen("close")+1));
         rfcomm->s = 0;
+        BluetoothHelpers::SignalControl(&rfcomm->mControl, CONTROL_CLOSE);
     }
 
-    // closing pipes
-    close(rfcomm->rep[0]);
-    close(rfcomm->rep[1]);
-
     return;
 }
 
@@ -403,3 +730,274 @@ NAN_METHOD(BTSerialPortBinding::Read) {
 
     return;
 }
+
+NAN_METHOD(BTSerialPortBinding::GetSocketInfo) {
+    BTSerialPortBinding* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBinding>(info.This());
+
+    socket_info_t socketInfo;
+    if (rfcomm->s == 0 || BluetoothHelpers::GetSocketInfo(rfcomm->s, &rfcomm->options, &socketInfo) < 0) {
+        return Nan::ThrowError("The connection has been closed");
+    }
+
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("address").ToLocalChecked(), Nan::New(socketInfo.remoteAddress).ToLocalChecked());
+    Nan::Set(result, Nan::New("channel").ToLocalChecked(), Nan::New(socketInfo.channel));
+    Nan::Set(result, Nan::New("adapter").ToLocalChecked(), Nan::New(socketInfo.localAddress).ToLocalChecked());
+    Nan::Set(result, Nan::New("mtu").ToLocalChecked(), Nan::New(socketInfo.mtu));
+    Nan::Set(result, Nan::New("sendBufferSize").ToLocalChecked(), Nan::New(socketInfo.sendBufferSize));
+    Nan::Set(result, Nan::New("receiveBufferSize").ToLocalChecked(), Nan::New(socketInfo.receiveBufferSize));
+    Nan::Set(result, Nan::New("priority").ToLocalChecked(), Nan::New(socketInfo.priority));
+    Nan::Set(result, Nan::New("linkMode").ToLocalChecked(), Nan::New(socketInfo.linkMode));
+
+    info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(BTSerialPortBinding::Detach) {
+    BTSerialPortBinding* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBinding>(info.This());
+
+    if (rfcomm->s == 0) {
+        return Nan::ThrowError("The connection has been closed");
+    }
+
+    // a queued write would otherwise end up on a descriptor we no longer own
+    uv_mutex_lock(&rfcomm->mWriteQueueMutex);
+    bool idle = ngx_queue_empty(&rfcomm->mWriteQueue);
+    uv_mutex_unlock(&rfcomm->mWriteQueueMutex);
+
+    if (!idle) {
+        return Nan::ThrowError("Cannot detach while writes are pending");
+    }
+
+    BluetoothHelpers::StopIdleTimer(&rfcomm->mIdle);
+
+    int fd = rfcomm->s;
+    rfcomm->s = 0;
+
+    // wake up a pending read, it returns without touching the socket
+    BluetoothHelpers::SignalControl(&rfcomm->mControl, CONTROL_DETACH);
+
+    info.GetReturnValue().Set(fd);
+}
+
+NAN_METHOD(BTSerialPortBinding::SendFd) {
+    const char *usage = "usage: BTSerialPortBinding.sendFd(channel, fd)";
+    if (info.Length() != 2 || !info[0]->IsNumber() || !info[1]->IsNumber()) {
+        return Nan::ThrowError(usage);
+    }
+
+    int channel = info[0]->Int32Value(Nan::GetCurrentContext()).ToChecked();
+    int fd = info[1]->Int32Value(Nan::GetCurrentContext()).ToChecked();
+
+    if (BluetoothHelpers::SendFd(channel, fd) < 0) {
+        char msg[512];
+        sprintf(msg, "Cannot send file descriptor: %s", strerror(errno));
+        return Nan::ThrowError(msg);
+    }
+}
+
+void BTSerialPortBinding::EIO_ReceiveFd(uv_work_t *req) {
+    receive_fd_baton_t *baton = static_cast<receive_fd_baton_t *>(req->data);
+
+    baton->fd = BluetoothHelpers::ReceiveFd(baton->channel);
+    if (baton->fd < 0) {
+        baton->errorno = errno;
+    }
+}
+
+void BTSerialPortBinding::EIO_AfterReceiveFd(uv_work_t *req) {
+    Nan::HandleScope scope;
+
+    receive_fd_baton_t *baton = static_cast<receive_fd_baton_t *>(req->data);
+
+    Nan::TryCatch try_catch;
+
+    Local<Value> argv[2];
+    if (baton->fd < 0) {
+        char msg[512];
+        sprintf(msg, "Cannot receive file descriptor: %s", strerror(baton->errorno));
+        argv[0] = Nan::Error(msg);
+        argv[1] = Nan::Undefined();
+    } else {
+        argv[0] = Nan::Undefined();
+        argv[1] = Nan::New(baton->fd);
+    }
+
+    Nan::AsyncResource resource("bluetooth-serial-port:ReceiveFd");
+    baton->cb->Call(2, argv, &resource);
+
+    if (try_catch.HasCaught()) {
+        Nan::FatalException(try_catch);
+    }
+
+    delete baton->cb;
+    delete baton;
+}
+
+NAN_METHOD(BTSerialPortBinding::ReceiveFd) {
+    const char *usage = "usage: BTSerialPortBinding.receiveFd(channel, callback)";
+    if (info.Length() != 2 || !info[0]->IsNumber() || !info[1]->IsFunction()) {
+        return Nan::ThrowError(usage);
+    }
+
+    receive_fd_baton_t *baton = new receive_fd_baton_t();
+    baton->channel = info[0]->Int32Value(Nan::GetCurrentContext()).ToChecked();
+    baton->fd = -1;
+    baton->errorno = 0;
+    baton->cb = new Nan::Callback(info[1].As<Function>());
+    baton->request.data = baton;
+
+    uv_queue_work(uv_default_loop(), &baton->request, EIO_ReceiveFd, (uv_after_work_cb)EIO_AfterReceiveFd);
+}
+
+NAN_METHOD(BTSerialPortBinding::SocketPair) {
+    const char *usage = "usage: BTSerialPortBinding.socketPair([type])";
+    if (info.Length() > 1) {
+        return Nan::ThrowError(usage);
+    }
+
+    int type = SOCK_STREAM;
+    if (info.Length() == 1 && !info[0]->IsUndefined()) {
+        String::Utf8Value typeName(info.GetIsolate(), info[0]);
+        if (strcmp(*typeName, "seqpacket") == 0) {
+            type = SOCK_SEQPACKET;
+        } else if (strcmp(*typeName, "stream") != 0) {
+            return Nan::ThrowTypeError("Type should be either 'stream' or 'seqpacket'.");
+        }
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, fds) < 0) {
+        char msg[512];
+        sprintf(msg, "Cannot create socket pair: %s", strerror(errno));
+        return Nan::ThrowError(msg);
+    }
+
+    Local<Array> result = Nan::New<Array>(2);
+    Nan::Set(result, 0, Nan::New(fds[0]));
+    Nan::Set(result, 1, Nan::New(fds[1]));
+
+    info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(BTSerialPortBinding::GetAdapters) {
+    std::vector<adapter_stats_t> adapters;
+    if (BluetoothHelpers::GetAdapterStats(adapters) < 0) {
+        char msg[512];
+        sprintf(msg, "Cannot list adapters: %s", strerror(errno));
+        return Nan::ThrowError(msg);
+    }
+
+    Local<Array> result = Nan::New<Array>(adapters.size());
+    for (size_t i = 0; i < adapters.size(); i++) {
+        char name[16];
+        sprintf(name, "hci%d", adapters[i].devId);
+
+        Local<Object> adapter = Nan::New<Object>();
+        Nan::Set(adapter, Nan::New("name").ToLocalChecked(), Nan::New(name).ToLocalChecked());
+        Nan::Set(adapter, Nan::New("address").ToLocalChecked(), Nan::New(adapters[i].address).ToLocalChecked());
+        Nan::Set(adapter, Nan::New("links").ToLocalChecked(), Nan::New(adapters[i].links));
+        Nan::Set(adapter, Nan::New("throughput").ToLocalChecked(), Nan::New(adapters[i].throughput));
+        Nan::Set(result, i, adapter);
+    }
+
+    info.GetReturnValue().Set(result);
+}
+
+// Runs the placement policy over the given adapters, e.g. the result of
+// getAdapters() or simulated ones. Returns the index of the chosen adapter.
+NAN_METHOD(BTSerialPortBinding::ChooseAdapter) {
+    const char *usage = "usage: BTSerialPortBinding.chooseAdapter(adapters)";
+    if (info.Length() != 1 || !info[0]->IsArray()) {
+        return Nan::ThrowError(usage);
+    }
+
+    Local<Array> jsAdapters = info[0].As<Array>();
+    std::vector<adapter_stats_t> adapters;
+    for (uint32_t i = 0; i < jsAdapters->Length(); i++) {
+        Local<Value> value = Nan::Get(jsAdapters, i).ToLocalChecked();
+        if (!value->IsObject()) {
+            return Nan::ThrowTypeError("Adapters should be objects with links and throughput.");
+        }
+        Local<Object> jsAdapter = value.As<Object>();
+
+        adapter_stats_t stats;
+        memset(&stats, 0, sizeof(stats));
+        stats.devId = i;
+        Local<Value> links = Nan::Get(jsAdapter, Nan::New("links").ToLocalChecked()).ToLocalChecked();
+        Local<Value> throughput = Nan::Get(jsAdapter, Nan::New("throughput").ToLocalChecked()).ToLocalChecked();
+        stats.links = links->Int32Value(Nan::GetCurrentContext()).FromMaybe(0);
+        stats.throughput = throughput->NumberValue(Nan::GetCurrentContext()).FromMaybe(0);
+        if (stats.throughput != stats.throughput) {
+            stats.throughput = 0; // NaN, e.g. a missing property
+        }
+        adapters.push_back(stats);
+    }
+
+    info.GetReturnValue().Set(Nan::New(BluetoothHelpers::ChooseAdapter(adapters)));
+}
+
+// Writes one buffer to many connections: broadcast(connections, buffer, maxQueuedBytes, callback).
+// Every connection gets a write baton in its own queue, but they all share the
+// pinned buffer and the callback. Connections with more than maxQueuedBytes
+// waiting are skipped, a negative maxQueuedBytes queues on every connection.
+NAN_METHOD(BTSerialPortBinding::Broadcast) {
+    const char *usage = "usage: BTSerialPortBinding.broadcast(connections, buffer, maxQueuedBytes, callback)";
+    if (info.Length() != 4 || !info[0]->IsArray() || !info[2]->IsNumber() || !info[3]->IsFunction()) {
+        return Nan::ThrowError(usage);
+    }
+
+    if(!info[1]->IsObject() || !Buffer::HasInstance(info[1])) {
+        return Nan::ThrowTypeError("Second argument must be a buffer");
+    }
+
+    Local<Array> connections = info[0].As<Array>();
+    Local<Object> bufferObject = info[1].As<Object>();
+    double maxQueuedBytes = info[2]->NumberValue(Nan::GetCurrentContext()).FromMaybe(-1);
+    Local<FunctionTemplate> ct = Nan::New(s_ct);
+
+    broadcast_t *broadcast = new broadcast_t();
+    broadcast->buffer.Reset(bufferObject);
+    broadcast->callback = new Nan::Callback(info[3].As<Function>());
+    broadcast->written.assign(connections->Length(), 0);
+    broadcast->errors.resize(connections->Length());
+
+    // one extra reference until all writes are queued, so that writes that
+    // finish early can't report before the others are in
+    broadcast->pending = 1;
+
+    for (uint32_t i = 0; i < connections->Length(); i++) {
+        Local<Value> value = Nan::Get(connections, i).ToLocalChecked();
+        if (!ct->HasInstance(value)) {
+            broadcast->written[i] = -1;
+            broadcast->errors[i] = "Not a connection";
+            continue;
+        }
+
+        BTSerialPortBinding *rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBinding>(value.As<Object>());
+        if (rfcomm->s == 0) {
+            broadcast->written[i] = -1;
+            broadcast->errors[i] = "Attempting to write to a closed connection";
+            continue;
+        }
+
+        if (maxQueuedBytes >= 0 && rfcomm->mQueuedBytes > maxQueuedBytes) {
+            broadcast->written[i] = -1;
+            broadcast->errors[i] = "Skipped, too much data queued";
+            continue;
+        }
+
+        write_baton_t *baton = new write_baton_t();
+        baton->rfcomm = rfcomm;
+        baton->rfcomm->Ref();
+        baton->bufferData = Buffer::Data(bufferObject);
+        baton->bufferLength = Buffer::Length(bufferObject);
+        baton->broadcast = broadcast;
+        baton->broadcastIndex = i;
+
+        broadcast->pending++;
+        QueueWrite(baton);
+    }
+
+    // drop the extra reference, this reports right away when nothing was queued
+    ReleaseBroadcast(broadcast);
+}
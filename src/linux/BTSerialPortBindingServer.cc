@@ -16,6 +16,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <map>
@@ -33,6 +34,7 @@ extern "C"{
     #include <sys/ioctl.h>
     #include <sys/socket.h>
     #include <sys/types.h>
+    #include <sys/un.h>
     #include <assert.h>
     #include <bluetooth/bluetooth.h>
     #include <bluetooth/hci.h>
@@ -43,6 +45,8 @@ extern "C"{
 }
 
 #define CLIENT_CLOSED_CONNECTION "Connection closed by the client"
+#define IDLE_TIMEOUT "Idle timeout"
+#define CLIENT_CONNECTION_LOST "Connection lost"
 
 static const uint16_t _SPP_UUID = 0x1101; // Serial Port Profile UUID
 
@@ -118,31 +122,127 @@ static int str2uuid(const char *uuid_str, uuid_t *uuid)
     return 1;
 }
 
+// Reads a list of Bluetooth addresses, normalised the way ba2str() prints them
+static bool parseAddressList(Isolate *isolate, Local<Value> value, std::vector<std::string> &addresses)
+{
+    if (value->IsUndefined()) {
+        return true;
+    }
+    if (!value->IsArray()) {
+        return false;
+    }
+
+    Local<Array> list = value.As<Array>();
+    for (uint32_t i = 0; i < list->Length(); i++) {
+        String::Utf8Value item(isolate, Nan::Get(list, i).ToLocalChecked());
+        bdaddr_t ba;
+        char address[19];
+        if (*item == NULL || bachk(*item) < 0) {
+            return false;
+        }
+        str2ba(*item, &ba);
+        ba2str(&ba, address);
+        addresses.push_back(address);
+    }
+    return true;
+}
+
 
 void BTSerialPortBindingServer::EIO_Listen(uv_work_t *req) {
     listen_baton_t * baton = static_cast<listen_baton_t *>(req->data);
 
+    std::vector<service_t *> &services = baton->rfcomm->mServices;
+    for (size_t i = 0; i < services.size() && baton->status == 0; i++) {
+        ListenSocket(baton, services[i]);
+    }
+
+    // the services are registered once and stays registered across clients
+    // until the server is closed, all SDP traffic stays off the event loop
+    if (baton->status == 0 && (!baton->path[0] || baton->sdpPath[0])) {
+        baton->rfcomm->Advertise();
+    }
+}
+
+void BTSerialPortBindingServer::ListenSocket(listen_baton_t *baton, service_t *service) {
     struct sockaddr_rc addr = {
         0x00,
         { { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
         0x00
     };
 
+    if (baton->listenFd >= 0) {
+        // socket activation, the socket is already bound and listening
+        int accepting = 0;
+        socklen_t len = sizeof(accepting);
+        if (getsockopt(baton->listenFd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) < 0 || !accepting) {
+            baton->status = -1;
+            sprintf(baton->errorString, "The inherited socket is not listening. errno:%d", errno);
+            return;
+        }
+
+        service->s = baton->listenFd;
+
+        // advertise the channel the socket is actually bound to
+        len = sizeof(addr);
+        if (getsockname(baton->listenFd, (struct sockaddr *)&addr, &len) == 0 && addr.rc_family == AF_BLUETOOTH) {
+            service->channel = addr.rc_channel;
+        }
+
+        return;
+    }
+
+    int backlog = baton->backlog > 0 ? baton->backlog : 1; // Bluetooth only accepts one connection at a time
+
+    if (baton->path[0]) {
+        // a unix socket stands in for RFCOMM, there is nothing to advertise
+        struct sockaddr_un unixAddr;
+        memset(&unixAddr, 0, sizeof(unixAddr));
+        unixAddr.sun_family = AF_UNIX;
+        strncpy(unixAddr.sun_path, baton->path, sizeof(unixAddr.sun_path) - 1);
+
+        service->s = socket(AF_UNIX, SOCK_STREAM, 0);
+        baton->status = BluetoothHelpers::ApplySocketOptions(service->s, &baton->options);
+        if (baton->status == 0) {
+            baton->status = bind(service->s, (struct sockaddr *)&unixAddr, sizeof(unixAddr));
+        }
+        if (baton->status == 0) {
+            baton->status = listen(service->s, backlog);
+        }
+        if (baton->status) {
+            sprintf(baton->errorString, "Couldn't listen on %s. errno:%d", baton->path, errno);
+        }
+        return;
+    }
+
     // allocate a socket
-    baton->rfcomm->s = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+    service->s = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+
+    // the link mode of the listening socket applies to the accepted connections
+    baton->status = BluetoothHelpers::ApplySocketOptions(service->s, &baton->options);
+    if(baton->status){
+         sprintf(baton->errorString, "Couldn't set socket options. errno:%d", errno);
+         return;
+    }
 
     // set the connection parameters (who to connect to)
     addr.rc_family = AF_BLUETOOTH;
     bacpy(&addr.rc_bdaddr, &_BDADDR_ANY);
-    addr.rc_channel = (uint8_t) baton->listeningChannelID;
+    addr.rc_channel = (uint8_t) service->channel;
 
-    baton->status = bind(baton->rfcomm->s, (struct sockaddr *)&addr, sizeof(addr));
+    // only accept connections coming in over the requested adapter
+    if (baton->options.adapter >= 0 && hci_devba(baton->options.adapter, &addr.rc_bdaddr) < 0) {
+        baton->status = -1;
+        sprintf(baton->errorString, "Couldn't find adapter hci%d. errno:%d", baton->options.adapter, errno);
+        return;
+    }
+
+    baton->status = bind(service->s, (struct sockaddr *)&addr, sizeof(addr));
     if(baton->status){
-         sprintf(baton->errorString, "Couldn't bind bluetooth socket. errno:%d", errno);
+         sprintf(baton->errorString, "Couldn't bind bluetooth socket to channel %d. errno:%d", service->channel, errno);
          return;
     }
 
-    baton->status = listen(baton->rfcomm->s, 1); // Bluetooth only accepts one connection at a time
+    baton->status = listen(service->s, backlog);
     if(baton->status){
         sprintf(baton->errorString, "Couldn't listen on bluetooth socket. errno:%d", errno);
         return;
@@ -154,10 +254,23 @@ void BTSerialPortBindingServer::EIO_AfterListen(uv_work_t *req) {
     Nan::HandleScope scope;
 
     listen_baton_t * baton = static_cast<listen_baton_t *>(req->data);
+    BTSerialPortBindingServer *rfcomm = baton->rfcomm;
+
+    rfcomm->mListenPending = false;
+
+    // close() came in while listening, it left the cleanup and its Unref() to us
+    if (rfcomm->mClosed) {
+        rfcomm->ReleaseServices();
+        rfcomm->Unref();
+        return;
+    }
 
     Nan::TryCatch try_catch;
 
     if (baton->status != 0) {
+        // what did get set up must not stay open or advertised
+        rfcomm->ReleaseServices();
+
         Local<Value> argv[] = {
             Nan::Error(baton->errorString)
         };
@@ -171,40 +284,129 @@ void BTSerialPortBindingServer::EIO_AfterListen(uv_work_t *req) {
         Nan::FatalException(try_catch);
     }
 
-    baton->rfcomm->AdvertiseAndAccept();
+    rfcomm->Accept();
+}
+
+void BTSerialPortBindingServer::Accept() {
+    // Wait for incoming connections on the event loop, an idle server costs
+    // neither a thread nor wakeups no matter how many services it offers
+    for (size_t i = 0; i < mServices.size(); i++) {
+        service_t *service = mServices[i];
+        if (service->s == 0) {
+            continue;
+        }
+
+        if (service->poll == nullptr) {
+            int flags = fcntl(service->s, F_GETFL, 0);
+            fcntl(service->s, F_SETFL, flags | O_NONBLOCK);
+
+            service->poll = new uv_poll_t();
+            uv_poll_init(uv_default_loop(), service->poll, service->s);
+            service->poll->data = service;
+        }
+
+        uv_poll_start(service->poll, UV_READABLE, OnAcceptable);
+    }
+}
+
+void BTSerialPortBindingServer::PauseAccepting() {
+    for (size_t i = 0; i < mServices.size(); i++) {
+        if (mServices[i]->poll != nullptr) {
+            uv_poll_stop(mServices[i]->poll);
+        }
+    }
+}
+
+void BTSerialPortBindingServer::StopAccepting() {
+    for (size_t i = 0; i < mServices.size(); i++) {
+        service_t *service = mServices[i];
+        if (service->poll != nullptr) {
+            uv_poll_stop(service->poll);
+            uv_close(reinterpret_cast<uv_handle_t *>(service->poll), [](uv_handle_t *handle) {
+                delete reinterpret_cast<uv_poll_t *>(handle);
+            });
+            service->poll = nullptr;
+        }
+    }
 }
 
-void BTSerialPortBindingServer::AdvertiseAndAccept() {
-    // Register the service via SDP daemon
-    this->Advertise();
+// Runs for every accepted client before javascript hears of it. The filter
+// goes first because it is free, a token is only spent on clients we keep.
+bool BTSerialPortBindingServer::Admit(const char *address) {
+    admission_t &admission = mAdmission;
+    bool multiClient = mListenBaton->backlog > 0;
+
+    if (std::find(admission.deny.begin(), admission.deny.end(), address) != admission.deny.end() ||
+        (!admission.allow.empty() && std::find(admission.allow.begin(), admission.allow.end(), address) == admission.allow.end())) {
+        admission.rejectedFilter++;
+        return false;
+    }
+
+    if (multiClient && admission.maxClients > 0 && admission.clients >= admission.maxClients) {
+        admission.rejectedMaxClients++;
+        return false;
+    }
+
+    if (admission.rate > 0) {
+        uint64_t now = uv_hrtime();
+        admission.tokens = std::min(admission.burst, admission.tokens + (now - admission.refilled) / 1e9 * admission.rate);
+        admission.refilled = now;
+        if (admission.tokens < 1) {
+            admission.rejectedRate++;
+            return false;
+        }
+        admission.tokens -= 1;
+    }
+
+    admission.accepted++;
+    if (multiClient) {
+        admission.clients++;
+    }
+    return true;
+}
 
-    // Accept an incoming connection asynchronously
-    auto callback = new Nan::Callback(this->mListenBaton->cb->GetFunction());
-    AsyncQueueWorker(new ClientWorker(callback, this->mListenBaton));
+bool BTSerialPortBindingServer::IsListening() {
+    for (size_t i = 0; i < mServices.size(); i++) {
+        if (mServices[i]->s != 0) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void BTSerialPortBindingServer::EIO_Write(uv_work_t *req) {
     queued_write_t *queuedWrite = static_cast<queued_write_t*>(req->data);
-    write_baton_t *data = static_cast<write_baton_t*>(queuedWrite->baton);
+    write_baton_t *data = queuedWrite->baton.get();
 
     BTSerialPortBindingServer* rfcomm = data->rfcomm;
+    int clientSocket = rfcomm->mClientSocket;
+    data->result = 0;
 
-    if (!rfcomm->mClientSocket || rfcomm->mClientSocket == -1) {
+    if (!clientSocket || clientSocket == -1) {
         sprintf(data->errorString, "Attempting to write to a closed connection");
+        return;
     }
 
-    data->result = ::write(rfcomm->mClientSocket, data->bufferData, data->bufferLength);
-
-    if (data->result != data->bufferLength) {
-        sprintf(data->errorString, "Writing attempt was unsuccessful");
+    // the socket is non-blocking, a short write means the send buffer is full
+    while (data->result < data->bufferLength) {
+        ssize_t bytesSent = ::write(clientSocket, (char *)data->bufferData + data->result, data->bufferLength - data->result);
+        if (bytesSent >= 0) {
+            data->result += bytesSent;
+        } else if (errno == EINTR) {
+            continue;
+        } else if ((errno != EAGAIN && errno != EWOULDBLOCK) || !BluetoothHelpers::WaitWritable(clientSocket)) {
+            sprintf(data->errorString, "Writing attempt was unsuccessful: %s", strerror(errno));
+            return;
+        }
     }
 }
 
 void BTSerialPortBindingServer::EIO_AfterWrite(uv_work_t *req) {
     Nan::HandleScope scope;
 
-    queued_write_t *queuedWrite = static_cast<queued_write_t*>(req->data);
-    write_baton_t *data = static_cast<write_baton_t*>(queuedWrite->baton);
+    // the baton goes with it, releasing the buffer, the callback and our reference
+    std::unique_ptr<queued_write_t> queuedWrite(static_cast<queued_write_t*>(req->data));
+    write_baton_t *data = queuedWrite->baton.get();
 
     Local<Value> argv[2];
     if (data->errorString[0]) {
@@ -228,12 +430,6 @@ void BTSerialPortBindingServer::EIO_AfterWrite(uv_work_t *req) {
         uv_queue_work(uv_default_loop(), &nextQueuedWrite->req, EIO_Write, (uv_after_work_cb)EIO_AfterWrite);
     }
     uv_mutex_unlock(&data->rfcomm->mWriteQueueMutex);
-
-    data->buffer.Reset();
-    delete data->callback;
-    data->rfcomm->Unref();
-    delete data;
-    delete queuedWrite;
 }
 
 void BTSerialPortBindingServer::EIO_Read(uv_work_t *req) {
@@ -241,83 +437,102 @@ void BTSerialPortBindingServer::EIO_Read(uv_work_t *req) {
 
     read_baton_t *baton = static_cast<read_baton_t *>(req->data);
 
+    // detachClient() hands the client socket over from the main thread, work on a copy
+    int clientSocket = baton->rfcomm->mClientSocket;
+    int control = baton->rfcomm->mControl.fd;
+
     memset(buf, 0, sizeof(buf));
 
-    fd_set set;
-    FD_ZERO(&set);
-    FD_SET(baton->rfcomm->mClientSocket, &set);
-    FD_SET(baton->rfcomm->rep[0], &set);
+    int nfds = (clientSocket > control) ? clientSocket : control;
+
+    // the client socket is non-blocking, wait again when readiness was spurious
+    bool retry;
+    do {
+        retry = false;
+
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(control, &set);
+        if (clientSocket != 0) {
+            FD_SET(clientSocket, &set);
+        }
 
-    int nfds = (baton->rfcomm->mClientSocket > baton->rfcomm->rep[0]) ? baton->rfcomm->mClientSocket : baton->rfcomm->rep[0];
+        if (pselect(nfds + 1, &set, NULL, NULL, NULL, NULL) < 0) {
+            retry = (errno == EINTR);
+            continue;
+        }
 
-    if (pselect(nfds + 1, &set, NULL, NULL, NULL, NULL) >= 0) {
-        if (FD_ISSET(baton->rfcomm->mClientSocket, &set)) {
-            baton->size = ::read(baton->rfcomm->mClientSocket, buf, sizeof(buf));
-            if(baton->size < 0){
+        // control commands win from pending data, a detached socket must not be read
+        if (FD_ISSET(control, &set)) {
+            int commands = BluetoothHelpers::TakeControl(&baton->rfcomm->mControl);
+            baton->isClose = (commands & CONTROL_CLOSE) != 0;
+            baton->isDisconnect = (commands & CONTROL_DISCONNECT) != 0;
+            baton->isTimeout = (commands & CONTROL_TIMEOUT) != 0;
+            baton->size = 0;
+            // a wake-up without commands was left behind by an earlier signal
+            retry = (commands == 0);
+        }else if (clientSocket != 0 && FD_ISSET(clientSocket, &set)) {
+            baton->size = ::read(clientSocket, buf, sizeof(buf));
+            if(baton->size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+                retry = true;
+            }else if(baton->size < 0){
                 baton->errorno = errno;
             }else if (baton->size > 0) {
                 memcpy(baton->result, buf, baton->size);
+                BluetoothHelpers::TouchIdleTimer(&baton->rfcomm->mIdle);
             }
-        }else if(FD_ISSET(baton->rfcomm->rep[0], &set)) {
-          int size = ::read(baton->rfcomm->rep[0], buf, sizeof(buf));
-          if(size<0){
-            baton->errorno = errno;
-          }
-          buf[size] = '\0';
-          std::string strBuffer(reinterpret_cast<const char *>(buf));
-          if(strBuffer == "close") {
-            baton->isClose = true;
-            baton->size = 0;
-          } else if (strBuffer == "disconnect") {
-            baton->isDisconnect = true;
-          }
         }else{
           baton->size = 0;
         }
-    }
+    } while (retry);
 }
 
 void BTSerialPortBindingServer::EIO_AfterRead(uv_work_t *req) {
     Nan::HandleScope scope;
 
-    read_baton_t *baton = static_cast<read_baton_t *>(req->data);
+    // released on every way out of here, with it the callback and our reference
+    std::unique_ptr<read_baton_t> baton(static_cast<read_baton_t *>(req->data));
 
     Nan::TryCatch try_catch;
 
     Local<Value> argv[2];
 
     Nan::AsyncResource resource("bluetooth-serial-port:server.Read");
+    if (baton->isDisconnect) {
+        baton->rfcomm->mDetaching = false;
+    }
+
     if (baton->size <= 0) {
-        char msg[512];
-        sprintf(msg, "Error reading from connection: errno: %d", baton->errorno);
-        argv[0] = Nan::Error(msg);
-        argv[1] = Nan::Undefined();
-        if(baton->errorno == ECONNRESET || baton->errorno == ETIMEDOUT || baton->size == 0 || baton->isDisconnect){
-            baton->rfcomm->CloseClientSocket();
-            if (!baton->isClose) {
-                baton->rfcomm->AdvertiseAndAccept();
-            }
-            argv[0] = Nan::Error(CLIENT_CLOSED_CONNECTION);
-            baton->cb->Call(2, argv, &resource);
+        // EIO_Read already retried EAGAIN and EINTR, any error left ends the connection
+        // and the next client has to be accepted, or the server would stay deaf
+        baton->rfcomm->CloseClientSocket();
+        if (!baton->isClose) {
+            baton->rfcomm->Accept();
         }
-        return;
-    }
 
-    Local<Object> resultBuffer = Nan::NewBuffer(baton->size).ToLocalChecked();
-    memcpy(Buffer::Data(resultBuffer), baton->result, baton->size);
+        if (baton->isTimeout) {
+            argv[0] = Nan::Error(IDLE_TIMEOUT);
+        } else if (baton->size < 0) {
+            Local<Object> error = Nan::Error(CLIENT_CONNECTION_LOST).As<Object>();
+            Nan::Set(error, Nan::New("errno").ToLocalChecked(), Nan::New<v8::Integer>(baton->errorno));
+            argv[0] = error;
+        } else {
+            argv[0] = Nan::Error(CLIENT_CLOSED_CONNECTION);
+        }
+        argv[1] = Nan::Undefined();
+    } else {
+        Local<Object> resultBuffer = Nan::NewBuffer(baton->size).ToLocalChecked();
+        memcpy(Buffer::Data(resultBuffer), baton->result, baton->size);
 
-    argv[0] = Nan::Undefined();
-    argv[1] = resultBuffer;
+        argv[0] = Nan::Undefined();
+        argv[1] = resultBuffer;
+    }
 
     baton->cb->Call(2, argv, &resource);
 
     if (try_catch.HasCaught()) {
         Nan::FatalException(try_catch);
     }
-
-    baton->rfcomm->Unref();
-    delete baton->cb;
-    delete baton;
 }
 
 void BTSerialPortBindingServer::Init(Local<Object> target) {
@@ -335,20 +550,40 @@ void BTSerialPortBindingServer::Init(Local<Object> target) {
     Nan::SetPrototypeMethod(t, "read", Read);
     Nan::SetPrototypeMethod(t, "close", Close);
     Nan::SetPrototypeMethod(t, "disconnectClient", DisconnectClient);
+    Nan::SetPrototypeMethod(t, "detachClient", DetachClient);
     Nan::SetPrototypeMethod(t, "isOpen", IsOpen);
+    Nan::SetPrototypeMethod(t, "getSocketInfo", GetSocketInfo);
+    Nan::SetPrototypeMethod(t, "releaseClient", ReleaseClient);
+    Nan::SetPrototypeMethod(t, "getStats", GetStats);
 
     Nan::Set(target, Nan::New("BTSerialPortBindingServer").ToLocalChecked(), t->GetFunction(ctx).ToLocalChecked());
 }
 
-BTSerialPortBindingServer::BTSerialPortBindingServer() :
-    s(0) {
+BTSerialPortBindingServer::BTSerialPortBindingServer() {
+    mControl.fd = -1;
+    mControl.commands = 0;
     mListenBaton = new listen_baton_t();
+    mListenBaton->listenFd = -1;
+    mListenBaton->backlog = 0;
+    mListenBaton->path[0] = '\0';
+    mListenBaton->sdpPath[0] = '\0';
+    BluetoothHelpers::InitSocketOptions(&mListenBaton->options);
+    BluetoothHelpers::InitIdleTimer(&mIdle, this, OnIdleExpired, OnIdleProbe);
 }
 
 BTSerialPortBindingServer::~BTSerialPortBindingServer() {
-    if (mListenBaton->ecb) { mListenBaton->ecb->Reset(); }
-    if (mListenBaton->cb) { mListenBaton->cb->Reset(); }
     delete mListenBaton;
+
+    BluetoothHelpers::StopIdleTimer(&mIdle);
+
+    // not before now, a pending read may still be waiting on it
+    BluetoothHelpers::CloseControl(&mControl);
+
+    // a server that was never closed still has its services advertised
+    ReleaseServices();
+    for (size_t i = 0; i < mServices.size(); i++) {
+        delete mServices[i];
+    }
 }
 
 NAN_METHOD(BTSerialPortBindingServer::New) {
@@ -396,25 +631,155 @@ NAN_METHOD(BTSerialPortBindingServer::New) {
         options[propertyName] = std::string(*String::Utf8Value(isolate, optionValue));
     }
 
-    if(!str2uuid(options["uuid"].c_str(), &baton->uuid)){
-        return Nan::ThrowError("The UUID is invalid");
+    // either a single service from uuid and channel or the services array
+    Local<Value> jsServices = Nan::Get(jsOptions, Nan::New("services").ToLocalChecked()).ToLocalChecked();
+    if (jsServices->IsArray()) {
+        Local<Array> list = jsServices.As<Array>();
+        if (list->Length() == 0) {
+            return Nan::ThrowTypeError("Option services should list at least one service.");
+        }
+
+        for (uint32_t i = 0; i < list->Length(); i++) {
+            Local<Value> item = Nan::Get(list, i).ToLocalChecked();
+            if (!item->IsObject()) {
+                return Nan::ThrowTypeError("Option services should be a list of objects with uuid and channel.");
+            }
+
+            Local<Object> jsService = item.As<Object>();
+            Local<Value> uuid = Nan::Get(jsService, Nan::New("uuid").ToLocalChecked()).ToLocalChecked();
+            Local<Value> channel = Nan::Get(jsService, Nan::New("channel").ToLocalChecked()).ToLocalChecked();
+
+            service_t *service = new service_t();
+            service->rfcomm = rfcomm;
+            service->uuidString = *String::Utf8Value(isolate, uuid);
+            service->channel = channel->Int32Value(ctx).FromMaybe(0);
+
+            if(!str2uuid(service->uuidString.c_str(), &service->uuid)){
+                delete service;
+                return Nan::ThrowError("The UUID is invalid");
+            }
+            if(service->channel < 1 || service->channel > 30){
+                delete service;
+                return Nan::ThrowTypeError("The channel of a service should be in the range of 1-30.");
+            }
+            rfcomm->mServices.push_back(service);
+        }
+    } else {
+        Local<Value> channel = Nan::Get(jsOptions, Nan::New("channel").ToLocalChecked()).ToLocalChecked();
+
+        service_t *service = new service_t();
+        service->rfcomm = rfcomm;
+        service->uuidString = options["uuid"];
+        service->channel = channel->Int32Value(ctx).FromMaybe(0);
+
+        if(!str2uuid(service->uuidString.c_str(), &service->uuid)){
+            delete service;
+            return Nan::ThrowError("The UUID is invalid");
+        }
+        if(service->channel < 1 || service->channel > 30){
+            delete service;
+            return Nan::ThrowTypeError("The channel should be in the range of 1-30.");
+        }
+        rfcomm->mServices.push_back(service);
+    }
+
+    std::string error;
+    if(!BluetoothHelpers::ParseSocketOptions(options, &baton->options, error)){
+        return Nan::ThrowTypeError(error.c_str());
+    }
+
+    // the probe is binary, it can't go through the string map
+    Local<Value> jsKeepaliveData = Nan::Get(jsOptions, Nan::New("keepaliveData").ToLocalChecked()).ToLocalChecked();
+    if (Buffer::HasInstance(jsKeepaliveData)) {
+        rfcomm->mKeepaliveData.assign(Buffer::Data(jsKeepaliveData), Buffer::Length(jsKeepaliveData));
+    } else if (jsKeepaliveData->IsString()) {
+        rfcomm->mKeepaliveData = *String::Utf8Value(isolate, jsKeepaliveData);
+    }
+
+    if(baton->options.keepaliveInterval > 0 && rfcomm->mKeepaliveData.empty()){
+        return Nan::ThrowTypeError("Option keepaliveInterval needs the keepaliveData to send.");
+    }
+
+    if(baton->options.adapter == ADAPTER_AUTO){
+        return Nan::ThrowTypeError("Option adapter 'auto' is only supported when connecting.");
     }
 
     baton->rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
 
-    // allocate an error pipe
-    if (pipe(baton->rfcomm->rep) == -1) {
-        return Nan::ThrowError("Cannot create pipe for reading.");
+    // allocate the channel that wakes up pending reads
+    if (baton->rfcomm->mControl.fd < 0 && BluetoothHelpers::OpenControl(&baton->rfcomm->mControl) < 0) {
+        return Nan::ThrowError("Cannot create control channel for reading.");
+    }
+
+    baton->cb.reset(new Nan::Callback(info[0].As<Function>()));
+    baton->ecb.reset(new Nan::Callback(info[1].As<Function>()));
+
+    if (options.count("fd") && options["fd"] != "undefined") {
+        baton->listenFd = atoi(options["fd"].c_str());
+        if (baton->listenFd < 0) {
+            return Nan::ThrowTypeError("Option fd should be a listening socket.");
+        }
     }
 
-    int flags = fcntl(baton->rfcomm->rep[0], F_GETFL, 0);
-    fcntl(baton->rfcomm->rep[0], F_SETFL, flags | O_NONBLOCK);
+    if (rfcomm->mServices.size() > 1 &&
+        ((options.count("fd") && options["fd"] != "undefined") || (options.count("path") && options["path"] != "undefined"))) {
+        return Nan::ThrowTypeError("Options fd and path only work with a single service.");
+    }
+
+    if (options.count("backlog") && options["backlog"] != "undefined") {
+        baton->backlog = atoi(options["backlog"].c_str());
+        if (baton->backlog <= 0) {
+            return Nan::ThrowTypeError("Option backlog should be a positive int value.");
+        }
+    }
+
+    if (options.count("path") && options["path"] != "undefined") {
+        if (options["path"].empty() || options["path"].size() >= sizeof(baton->path)) {
+            return Nan::ThrowTypeError("Option path should be a unix socket path.");
+        }
+        strcpy(baton->path, options["path"].c_str());
+    }
+
+    if (options.count("sdpPath") && options["sdpPath"] != "undefined") {
+        if (options["sdpPath"].empty() || options["sdpPath"].size() >= sizeof(baton->sdpPath)) {
+            return Nan::ThrowTypeError("Option sdpPath should be a unix socket path.");
+        }
+        strcpy(baton->sdpPath, options["sdpPath"].c_str());
+    }
+
+    admission_t &admission = rfcomm->mAdmission;
+    if (options.count("maxClients") && options["maxClients"] != "undefined") {
+        admission.maxClients = atoi(options["maxClients"].c_str());
+        if (admission.maxClients <= 0) {
+            return Nan::ThrowTypeError("Option maxClients should be a positive int value.");
+        }
+    }
+
+    if (options.count("acceptRate") && options["acceptRate"] != "undefined") {
+        admission.rate = atof(options["acceptRate"].c_str());
+        if (!(admission.rate > 0)) {
+            return Nan::ThrowTypeError("Option acceptRate should be a positive number.");
+        }
+        admission.burst = std::max(admission.rate, 1.0);
+    }
+
+    if (options.count("acceptBurst") && options["acceptBurst"] != "undefined") {
+        admission.burst = atof(options["acceptBurst"].c_str());
+        if (!(admission.burst >= 1)) {
+            return Nan::ThrowTypeError("Option acceptBurst should be a number of at least 1.");
+        }
+    }
+    admission.tokens = admission.burst;
+    admission.refilled = uv_hrtime();
+
+    if (!parseAddressList(isolate, Nan::Get(jsOptions, Nan::New("allow").ToLocalChecked()).ToLocalChecked(), admission.allow) ||
+        !parseAddressList(isolate, Nan::Get(jsOptions, Nan::New("deny").ToLocalChecked()).ToLocalChecked(), admission.deny)) {
+        return Nan::ThrowTypeError("Options allow and deny should be lists of Bluetooth addresses.");
+    }
 
-    baton->cb = new Nan::Callback(info[0].As<Function>());
-    baton->ecb = new Nan::Callback(info[1].As<Function>());
-    baton->listeningChannelID = std::stoi(options["channel"]);
     baton->request.data = baton;
     baton->rfcomm->Ref();
+    baton->rfcomm->mListenPending = true;
 
     uv_queue_work(uv_default_loop(), &baton->request, EIO_Listen, (uv_after_work_cb)EIO_AfterListen);
 
@@ -422,10 +787,45 @@ NAN_METHOD(BTSerialPortBindingServer::New) {
 }
 
 
-void BTSerialPortBindingServer::Advertise() {
+// Opens a session with the local SDP daemon. `path` points the session at a
+// stand-in for the daemon socket instead, e.g. for testing.
+static sdp_session_t *connectSdp(const char *path) {
+    if (!path[0]) {
+        return sdp_connect(&_BDADDR_ANY, &_BDADDR_LOCAL, SDP_RETRY_IF_BUSY);
+    }
 
-    listen_baton_t * baton = mListenBaton;
-    uint8_t rfcomm_channel = (uint8_t) baton->listeningChannelID;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return NULL;
+    }
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int error = errno;
+        close(sock);
+        errno = error;
+        return NULL;
+    }
+
+    // the same as sdp_connect() sets up for a local session, sdp_close() frees it
+    sdp_session_t *session = (sdp_session_t *)calloc(1, sizeof(sdp_session_t));
+    if (session == NULL) {
+        close(sock);
+        return NULL;
+    }
+    session->sock = sock;
+    session->local = 1;
+    session->flags = SDP_RETRY_IF_BUSY;
+    return session;
+}
+
+// Builds the SDP record that advertises an RFCOMM service
+static sdp_record_t *buildRecord(uuid_t *uuid, int channelID) {
+    uint8_t rfcomm_channel = (uint8_t) channelID;
 
     std::string service_name = "RFCOMM custom service";
     const char *service_dsc = "An RFCOMM listening socket";
@@ -441,9 +841,9 @@ void BTSerialPortBindingServer::Advertise() {
 
     sdp_record_t *record = sdp_record_alloc();
 
-    sdp_set_service_id(record, baton->uuid);
+    sdp_set_service_id(record, *uuid);
 
-    service_class_list = sdp_list_append(0, &baton->uuid);
+    service_class_list = sdp_list_append(0, uuid);
     sdp_set_service_classes(record, service_class_list);
 
     sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
@@ -466,28 +866,12 @@ void BTSerialPortBindingServer::Advertise() {
 
     // Set the service name. If the UUID of the service
     // is the one from Serial Port profile
-    if(baton->uuid.value.uuid16 == _SPP_UUID){
+    if(uuid->value.uuid16 == _SPP_UUID){
         service_name = "Serial Port";
     }
 
     sdp_set_info_attr(record, service_name.c_str(), NULL, service_dsc);
 
-    // Connect to the local SDP server
-    mSdpSession = sdp_connect(&_BDADDR_ANY, &_BDADDR_LOCAL, SDP_RETRY_IF_BUSY);
-    if(mSdpSession == NULL){
-        baton->status = -1;
-        sprintf(baton->errorString, "Cannot connect to SDP Daemon. errno: %d", errno);
-        goto cleanup;
-    }
-
-    // Register the service record.
-    if(sdp_record_register(mSdpSession, record, 0) == -1){
-        baton->status = -1;
-        sprintf(baton->errorString, "Cannot register SDP record. errno: %d", errno);
-        goto cleanup;
-    }
-
-cleanup:
     // cleanup
     sdp_data_free(channel);
     sdp_list_free(l2cap_list, 0);
@@ -495,10 +879,64 @@ cleanup:
     sdp_list_free(service_class_list, 0);
     sdp_list_free(root_list, 0);
     sdp_list_free(access_proto_list, 0);
-    sdp_record_free(record);
+
+    return record;
+}
+
+void BTSerialPortBindingServer::Advertise() {
+    listen_baton_t * baton = mListenBaton;
+
+    // Connect to the local SDP server, one session carries all services
+    mSdpSession = connectSdp(baton->sdpPath);
+    if(mSdpSession == NULL){
+        baton->status = -1;
+        sprintf(baton->errorString, "Cannot connect to SDP Daemon. errno: %d", errno);
+        return;
+    }
+
+    // Register the service records. The SDP daemon drops them when the
+    // session is closed, so they are kept for as long as the server is open.
+    for (size_t i = 0; i < mServices.size(); i++) {
+        service_t *service = mServices[i];
+        service->record = buildRecord(&service->uuid, service->channel);
+
+        if(sdp_record_register(mSdpSession, service->record, 0) == -1){
+            baton->status = -1;
+            sprintf(baton->errorString, "Cannot register SDP record for %s. errno: %d", service->uuidString.c_str(), errno);
+            return;
+        }
+    }
+}
+
+// Unregisters the services and closes their listening sockets, whatever part
+// of them was set up.
+void BTSerialPortBindingServer::ReleaseServices() {
+    // Close the connection with the SDP server, this unregisters the service.
+    // It only closes the socket, no round trip to the daemon.
+    if (mSdpSession){
+        sdp_close(mSdpSession);
+        mSdpSession = nullptr;
+    }
+    for (size_t i = 0; i < mServices.size(); i++) {
+        if (mServices[i]->record) {
+            sdp_record_free(mServices[i]->record);
+            mServices[i]->record = nullptr;
+        }
+    }
+
+    // Close server sockets, the polls have to go first
+    StopAccepting();
+    for (size_t i = 0; i < mServices.size(); i++) {
+        if (mServices[i]->s != 0) {
+            close(mServices[i]->s);
+            mServices[i]->s = 0;
+        }
+    }
 }
 
 void BTSerialPortBindingServer::CloseClientSocket() {
+    BluetoothHelpers::StopIdleTimer(&mIdle);
+
     // close the socket to the client
     if (mClientSocket != 0) {
         shutdown(mClientSocket, SHUT_RDWR);
@@ -519,27 +957,18 @@ NAN_METHOD(BTSerialPortBindingServer::Write) {
     }
 
     Local<Object> bufferObject = info[0].As<Object>();
-    char* bufferData = Buffer::Data(bufferObject);
-    size_t bufferLength = Buffer::Length(bufferObject);
 
     // callback
     if(!info[1]->IsFunction()) {
         return Nan::ThrowTypeError("Second argument must be a function");
     }
 
-    write_baton_t *baton = new write_baton_t();
-    memset(baton, 0, sizeof(write_baton_t));
-    baton->rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
-    baton->rfcomm->Ref();
-    baton->buffer.Reset(bufferObject);
-    baton->bufferData = bufferData;
-    baton->bufferLength = bufferLength;
-    baton->callback = new Nan::Callback(info[1].As<Function>());
+    BTSerialPortBindingServer *rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
 
     queued_write_t *queuedWrite = new queued_write_t();
-    memset(queuedWrite, 0, sizeof(queued_write_t));
-    queuedWrite->baton = baton;
+    queuedWrite->baton.reset(new write_baton_t(rfcomm, bufferObject, info[1].As<Function>()));
     queuedWrite->req.data = queuedWrite;
+    write_baton_t *baton = queuedWrite->baton.get();
 
     uv_mutex_lock(&baton->rfcomm->mWriteQueueMutex);
     bool empty = ngx_queue_empty(&baton->rfcomm->mWriteQueue);
@@ -557,33 +986,27 @@ NAN_METHOD(BTSerialPortBindingServer::Write) {
 NAN_METHOD(BTSerialPortBindingServer::Close) {
     BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
 
-    // closing pipes
-    if(rfcomm->rep[1]){
-        int len = ::write(rfcomm->rep[1], "close", (strlen("close")+1));
-        if(len < 0 && errno != EWOULDBLOCK) {
-            return Nan::ThrowError("Cannot write to pipe!");
-        }
+    if (rfcomm->mClosed) {
+        return;
     }
-    if(rfcomm->rep[0] != 0) close(rfcomm->rep[0]);
-    if(rfcomm->rep[1] != 0) close(rfcomm->rep[1]);
 
-    rfcomm->rep[0] = rfcomm->rep[1] = 0;
-
-    // Close the connection with the SDP server
-    if (rfcomm->mSdpSession){
-        sdp_close(rfcomm->mSdpSession);
-        rfcomm->mSdpSession = nullptr;
+    // wake up a pending read, the channel itself is closed in the destructor
+    if(rfcomm->mControl.fd >= 0 && BluetoothHelpers::SignalControl(&rfcomm->mControl, CONTROL_CLOSE) < 0){
+        return Nan::ThrowError("Cannot signal the control channel!");
     }
+    rfcomm->mClosed = true;
 
     // close client socket
     rfcomm->CloseClientSocket();
 
-    // Close server socket
-    if (rfcomm->s != 0) {
-        close(rfcomm->s);
-        rfcomm->s = 0; // Inform `ClientWorker` to stop `pselect` loop to accept connections if ongoing.
+    // the listen worker may still be opening sockets and registering records,
+    // EIO_AfterListen releases them and drops the reference once it is done
+    if (rfcomm->mListenPending) {
+        return;
     }
 
+    rfcomm->ReleaseServices();
+
     // Call unref so we can be garbage collected (rest of cleanup is in the destructor)
     rfcomm->Unref();
 
@@ -600,8 +1023,9 @@ NAN_METHOD(BTSerialPortBindingServer::Read) {
 
     BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
 
-    // callback with an error if the connection has been closed.
-    if (rfcomm->mClientSocket == 0) {
+    // callback with an error if the connection has been closed. After detachClient()
+    // the reader still has to pick up the disconnect, which accepts the next client.
+    if (rfcomm->mClientSocket == 0 && !rfcomm->mDetaching) {
         Local<Value> argv[2];
 
         argv[0] = Nan::Error(CLIENT_CLOSED_CONNECTION);
@@ -612,105 +1036,229 @@ NAN_METHOD(BTSerialPortBindingServer::Read) {
         nc->Call(2, argv, &resource);
         return;
     }
-    read_baton_t *baton = new read_baton_t();
-    baton->rfcomm = rfcomm;
-    baton->cb = new Nan::Callback(cb);
-    baton->request.data = baton;
-    baton->rfcomm->Ref();
+    read_baton_t *baton = new read_baton_t(rfcomm, cb);
     uv_queue_work(uv_default_loop(), &baton->request, EIO_Read, (uv_after_work_cb)EIO_AfterRead);
 }
 
 NAN_METHOD(BTSerialPortBindingServer::DisconnectClient) {
     BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
 
-    // send disconnect to internal pipe to stop blocking read operation and to disconnect the client socket
+    // signal disconnect on the control channel to stop blocking read operation and to disconnect the client socket
     // if we try to disconnect the client socket here, we might get a read error on the client socket
-    // before reading the disconnect message from the pipe
-    if(rfcomm->rep[1]){
-        int len = ::write(rfcomm->rep[1], "disconnect", (strlen("disconnect")+1));
-        if(len < 0 && errno != EWOULDBLOCK) {
-            return Nan::ThrowError("Cannot write to pipe!");
-        }
+    // before the reader sees the disconnect command
+    if(rfcomm->mControl.fd >= 0 && BluetoothHelpers::SignalControl(&rfcomm->mControl, CONTROL_DISCONNECT) < 0){
+        return Nan::ThrowError("Cannot signal the control channel!");
     }
 }
 
-NAN_METHOD(BTSerialPortBindingServer::IsOpen) {
+NAN_METHOD(BTSerialPortBindingServer::DetachClient) {
     BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
-    bool b = (rfcomm->mClientSocket != 0);
-    info.GetReturnValue().Set(b);
-}
 
-BTSerialPortBindingServer::ClientWorker::ClientWorker(Nan::Callback * cb, listen_baton_t * baton) :
-    AsyncWorker(cb),
-    mBaton(baton)
-{
-}
+    if (rfcomm->mClientSocket == 0) {
+        return Nan::ThrowError(CLIENT_CLOSED_CONNECTION);
+    }
 
-BTSerialPortBindingServer::ClientWorker::~ClientWorker()
-{}
+    // a queued write would otherwise end up on a descriptor we no longer own
+    uv_mutex_lock(&rfcomm->mWriteQueueMutex);
+    bool idle = ngx_queue_empty(&rfcomm->mWriteQueue);
+    uv_mutex_unlock(&rfcomm->mWriteQueueMutex);
 
+    if (!idle) {
+        return Nan::ThrowError("Cannot detach while writes are pending");
+    }
 
-void BTSerialPortBindingServer::ClientWorker::Execute(){
-    if(mBaton == nullptr){
-        return Nan::ThrowError("listen_baton_t is null!");
+    // without a client socket the disconnect below re-advertises and accepts
+    // the next client but leaves the socket itself open. A read that already
+    // took bytes off the socket still delivers them, the one after it parks on
+    // the control channel until the disconnect arrives.
+    int fd = rfcomm->mClientSocket;
+    rfcomm->mClientSocket = 0;
+    BluetoothHelpers::StopIdleTimer(&rfcomm->mIdle);
+
+    if(rfcomm->mControl.fd >= 0 && BluetoothHelpers::SignalControl(&rfcomm->mControl, CONTROL_DISCONNECT) < 0){
+        rfcomm->mClientSocket = fd;
+        return Nan::ThrowError("Cannot signal the control channel!");
     }
+    rfcomm->mDetaching = rfcomm->mControl.fd >= 0;
 
-    struct sockaddr_rc clientAddress = {
-        0x00,
-        { { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
-        0x00
-    };
-    socklen_t clientAddrLen = sizeof(clientAddress);
+    info.GetReturnValue().Set(fd);
+}
 
-    int select_status;
-    while (mBaton->rfcomm->s != 0) {
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(mBaton->rfcomm->s, &fds);
+NAN_METHOD(BTSerialPortBindingServer::IsOpen) {
+    BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
+    // in multi-client mode the server is open for as long as it is listening
+    bool b = rfcomm->mListenBaton->backlog > 0 ? rfcomm->IsListening() : rfcomm->mClientSocket != 0;
+    info.GetReturnValue().Set(b);
+}
 
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 333;
+NAN_METHOD(BTSerialPortBindingServer::GetSocketInfo) {
+    BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
 
-        select_status = select(mBaton->rfcomm->s + 1, &fds, NULL, NULL, &timeout);
-        if (select_status > 0) {
-            break;
-        }
-        else if (select_status == -1) {
-            return Nan::ThrowError("error pselect'ing socket!");
-        }
+    socket_info_t socketInfo;
+    if (rfcomm->mClientSocket == 0 || BluetoothHelpers::GetSocketInfo(rfcomm->mClientSocket, &rfcomm->mListenBaton->options, &socketInfo) < 0) {
+        return Nan::ThrowError(CLIENT_CLOSED_CONNECTION);
     }
 
-    if (mBaton->rfcomm->s == 0) {
-        // In middle of closing
-        return;
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("address").ToLocalChecked(), Nan::New(socketInfo.remoteAddress).ToLocalChecked());
+    Nan::Set(result, Nan::New("channel").ToLocalChecked(), Nan::New(socketInfo.channel));
+    Nan::Set(result, Nan::New("adapter").ToLocalChecked(), Nan::New(socketInfo.localAddress).ToLocalChecked());
+    Nan::Set(result, Nan::New("mtu").ToLocalChecked(), Nan::New(socketInfo.mtu));
+    Nan::Set(result, Nan::New("sendBufferSize").ToLocalChecked(), Nan::New(socketInfo.sendBufferSize));
+    Nan::Set(result, Nan::New("receiveBufferSize").ToLocalChecked(), Nan::New(socketInfo.receiveBufferSize));
+    Nan::Set(result, Nan::New("priority").ToLocalChecked(), Nan::New(socketInfo.priority));
+    Nan::Set(result, Nan::New("linkMode").ToLocalChecked(), Nan::New(socketInfo.linkMode));
+
+    info.GetReturnValue().Set(result);
+}
+
+// Called by the idle timer wheel when the single client sent nothing for
+// idleTimeout. The pending read drops the client and reports the timeout.
+void BTSerialPortBindingServer::OnIdleExpired(idle_timer_t *timer) {
+    BTSerialPortBindingServer *rfcomm = static_cast<BTSerialPortBindingServer *>(timer->data);
+
+    if (rfcomm->mClientSocket != 0) {
+        BluetoothHelpers::SignalControl(&rfcomm->mControl, CONTROL_TIMEOUT);
+        shutdown(rfcomm->mClientSocket, SHUT_RDWR);
     }
+}
 
-    mBaton->rfcomm->mClientSocket = accept(mBaton->rfcomm->s, (struct sockaddr *)&clientAddress, &clientAddrLen);
+void BTSerialPortBindingServer::OnIdleProbe(idle_timer_t *timer) {
+    BTSerialPortBindingServer *rfcomm = static_cast<BTSerialPortBindingServer *>(timer->data);
 
-    ba2str(&clientAddress.rc_bdaddr, mBaton->clientAddress);
+    // a probe must not end up in the middle of a write that is in progress
+    uv_mutex_lock(&rfcomm->mWriteQueueMutex);
+    if (rfcomm->mClientSocket != 0 && ngx_queue_empty(&rfcomm->mWriteQueue)) {
+        send(rfcomm->mClientSocket, rfcomm->mKeepaliveData.data(), rfcomm->mKeepaliveData.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    uv_mutex_unlock(&rfcomm->mWriteQueueMutex);
 }
 
-void BTSerialPortBindingServer::ClientWorker::HandleOKCallback(){
+// Called on the event loop when the listening socket has connections waiting.
+void BTSerialPortBindingServer::OnAcceptable(uv_poll_t *handle, int status, int events) {
     Nan::HandleScope scope;
 
-    if(mBaton->rfcomm->mSdpSession){
-        // Close the connection with the SDP server so it stops advertising the service
-        sdp_close(mBaton->rfcomm->mSdpSession);
-        mBaton->rfcomm->mSdpSession = nullptr;
+    service_t *service = static_cast<service_t *>(handle->data);
+    BTSerialPortBindingServer *rfcomm = service->rfcomm;
+    listen_baton_t *baton = rfcomm->mListenBaton;
+    Nan::AsyncResource resource("bluetooth-serial-port:server.Accept");
+
+    if (status < 0) {
+        rfcomm->StopAccepting();
+        char msg[512];
+        sprintf(msg, "Cannot wait for connections: %s", uv_strerror(status));
+        Local<Value> argv[] = {
+            Nan::Error(msg)
+        };
+        baton->ecb->Call(1, argv, &resource);
+        return;
     }
 
-    if(mBaton->rfcomm->mClientSocket == -1){
-        mBaton->status = -1;
-        sprintf(mBaton->errorString, "accept() failed!. errno: %d", errno);
+    // in multi-client mode take everything that is pending in one go
+    while (service->s != 0) {
+        struct sockaddr_storage clientAddress;
+        memset(&clientAddress, 0, sizeof(clientAddress));
+        socklen_t clientAddrLen = sizeof(clientAddress);
+
+        int client = accept4(service->s, (struct sockaddr *)&clientAddress, &clientAddrLen, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (client == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                return; // nothing (left) to accept, keep waiting
+            }
+
+            rfcomm->StopAccepting();
+            char msg[80];
+            sprintf(msg, "accept() failed!. errno: %d", errno);
+            Local<Value> argv[] = {
+                Nan::Error(msg)
+            };
+            baton->ecb->Call(1, argv, &resource);
+            return;
+        }
+
+        if (clientAddress.ss_family == AF_BLUETOOTH) {
+            ba2str(&((struct sockaddr_rc *)&clientAddress)->rc_bdaddr, baton->clientAddress);
+        } else {
+            baton->clientAddress[0] = '\0';
+        }
+
+        // shed load before javascript gets involved, closing is all a rejected client costs
+        if (!rfcomm->Admit(baton->clientAddress)) {
+            close(client);
+            continue;
+        }
+
+        // accepted sockets don't inherit buffer sizes and priority from the listening socket
+        socket_options_t clientOptions = baton->options;
+        clientOptions.linkMode = -1;
+        BluetoothHelpers::ApplySocketOptions(client, &clientOptions);
+
+        // tell javascript which of the services the client connected to
+        Local<Object> jsService = Nan::New<Object>();
+        Nan::Set(jsService, Nan::New("uuid").ToLocalChecked(), Nan::New(service->uuidString).ToLocalChecked());
+        Nan::Set(jsService, Nan::New("channel").ToLocalChecked(), Nan::New(service->channel));
+
+        if (baton->backlog > 0) {
+            // multi-client mode: keep advertising and hand the client to javascript,
+            // which answers true once a connection owns the socket. Until then it
+            // is ours to close, also when the server went away or the callback threw.
+            Local<Value> argv[] = {
+                Nan::New<v8::String>(baton->clientAddress).ToLocalChecked(),
+                Nan::New(client),
+                jsService
+            };
+
+            Nan::TryCatch try_catch;
+            Local<Value> taken;
+            if (!baton->cb->Call(3, argv, &resource).ToLocal(&taken) || !taken->IsTrue()) {
+                close(client);
+                if (rfcomm->mAdmission.clients > 0) {
+                    rfcomm->mAdmission.clients--;
+                }
+            }
+
+            if (try_catch.HasCaught()) {
+                Nan::FatalException(try_catch);
+            }
+            continue;
+        }
+
+        // one client at a time on all services, wait again once it is gone
+        rfcomm->PauseAccepting();
+        rfcomm->mClientSocket = client;
+        BluetoothHelpers::StartIdleTimer(&rfcomm->mIdle, &baton->options);
+
+        Local<Value> argv[] = {
+            Nan::New<v8::String>(baton->clientAddress).ToLocalChecked(),
+            Nan::Undefined(),
+            jsService
+        };
+        baton->cb->Call(3, argv, &resource);
         return;
     }
+}
 
-    Local<Value> argv[] = {
-        Nan::New<v8::String>((mBaton->clientAddress)).ToLocalChecked()
-    };
+NAN_METHOD(BTSerialPortBindingServer::ReleaseClient) {
+    BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
 
-    Nan::AsyncResource resource("bluetooth-serial-port:server.HandleOK");
-    callback->Call(1, argv, &resource);
+    // javascript tells us when a multi-client connection is gone, that frees its slot
+    if (rfcomm->mAdmission.clients > 0) {
+        rfcomm->mAdmission.clients--;
+    }
+}
 
+NAN_METHOD(BTSerialPortBindingServer::GetStats) {
+    BTSerialPortBindingServer* rfcomm = Nan::ObjectWrap::Unwrap<BTSerialPortBindingServer>(info.This());
+    admission_t &admission = rfcomm->mAdmission;
+
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("clients").ToLocalChecked(), Nan::New(admission.clients));
+    Nan::Set(result, Nan::New("accepted").ToLocalChecked(), Nan::New<v8::Number>((double)admission.accepted));
+    Nan::Set(result, Nan::New("rejected").ToLocalChecked(), Nan::New<v8::Number>(
+        (double)(admission.rejectedFilter + admission.rejectedMaxClients + admission.rejectedRate)));
+    Nan::Set(result, Nan::New("rejectedFilter").ToLocalChecked(), Nan::New<v8::Number>((double)admission.rejectedFilter));
+    Nan::Set(result, Nan::New("rejectedMaxClients").ToLocalChecked(), Nan::New<v8::Number>((double)admission.rejectedMaxClients));
+    Nan::Set(result, Nan::New("rejectedRate").ToLocalChecked(), Nan::New<v8::Number>((double)admission.rejectedRate));
+
+    info.GetReturnValue().Set(result);
 }
@@ -0,0 +1,1009 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <uv.h>
+#include "BluetoothHelpers.h"
+
+extern "C"{
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <stdio.h>
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/eventfd.h>
+    #include <sys/ioctl.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <sys/uio.h>
+
+    #include <bluetooth/bluetooth.h>
+    #include <bluetooth/hci.h>
+    #include <bluetooth/hci_lib.h>
+    #include <bluetooth/rfcomm.h>
+}
+
+static bool parseInt(const std::string &value, int *result) {
+    char *endptr;
+    long i = strtol(value.c_str(), &endptr, 0);
+    if (value.empty() || *endptr != '\0') {
+        return false;
+    }
+    *result = (int) i;
+    return true;
+}
+
+// Accepts either a number or a comma separated list of link mode names, e.g.
+// "auth,encrypt". Arrays passed in from javascript stringify to the latter.
+static bool parseLinkMode(const std::string &value, int *linkMode) {
+    if (parseInt(value, linkMode)) {
+        return true;
+    }
+
+    static const struct { const char *name; int flag; } modes[] = {
+        { "master", RFCOMM_LM_MASTER },
+        { "auth", RFCOMM_LM_AUTH },
+        { "encrypt", RFCOMM_LM_ENCRYPT },
+        { "trusted", RFCOMM_LM_TRUSTED },
+        { "reliable", RFCOMM_LM_RELIABLE },
+        { "secure", RFCOMM_LM_SECURE }
+    };
+
+    int result = 0;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+
+        std::string name = value.substr(start, end - start);
+        bool found = false;
+        for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+            if (name == modes[i].name) {
+                result |= modes[i].flag;
+                found = true;
+            }
+        }
+        if (!found && !name.empty()) {
+            return false;
+        }
+
+        start = end + 1;
+    }
+
+    *linkMode = result;
+    return true;
+}
+
+// Accepts "auto", an adapter name like "hci1", an adapter index or the
+// address of the adapter.
+bool BluetoothHelpers::ParseAdapter(const std::string &value, int *adapter) {
+    if (value == "auto") {
+        *adapter = ADAPTER_AUTO;
+        return true;
+    }
+
+    bdaddr_t address;
+    int devId;
+    if (parseInt(value, &devId)) {
+        if (devId < 0 || hci_devba(devId, &address) < 0) {
+            return false;
+        }
+    } else {
+        devId = hci_devid(value.c_str());
+        if (devId < 0) {
+            return false;
+        }
+    }
+
+    *adapter = devId;
+    return true;
+}
+
+void BluetoothHelpers::InitSocketOptions(socket_options_t *options) {
+    options->sendBufferSize = 0;
+    options->receiveBufferSize = 0;
+    options->priority = -1;
+    options->linkMode = -1;
+    options->mtu = RFCOMM_DEFAULT_MTU;
+    options->adapter = ADAPTER_ANY;
+    options->idleTimeout = 0;
+    options->keepaliveInterval = 0;
+}
+
+bool BluetoothHelpers::ParseSocketOptions(std::map<std::string, std::string> &values, socket_options_t *options, std::string &error) {
+    // 0 turns the others off or keeps the system default, a frame size has to hold a byte
+    static const struct { const char *name; int socket_options_t::*field; int minimum; } numbers[] = {
+        { "sendBufferSize", &socket_options_t::sendBufferSize, 0 },
+        { "receiveBufferSize", &socket_options_t::receiveBufferSize, 0 },
+        { "priority", &socket_options_t::priority, 0 },
+        { "mtu", &socket_options_t::mtu, 1 },
+        { "idleTimeout", &socket_options_t::idleTimeout, 0 },
+        { "keepaliveInterval", &socket_options_t::keepaliveInterval, 0 }
+    };
+
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        std::map<std::string, std::string>::iterator it = values.find(numbers[i].name);
+        if (it == values.end() || it->second == "undefined") {
+            continue;
+        }
+        if (!parseInt(it->second, &(options->*numbers[i].field)) || options->*numbers[i].field < numbers[i].minimum) {
+            error = std::string("Option ") + numbers[i].name + " should be an int value of at least " +
+                std::to_string(numbers[i].minimum) + ".";
+            return false;
+        }
+    }
+
+    std::map<std::string, std::string>::iterator it = values.find("linkMode");
+    if (it != values.end() && it->second != "undefined") {
+        if (!parseLinkMode(it->second, &options->linkMode)) {
+            error = "Option linkMode should be a number or a list of: master, auth, encrypt, trusted, reliable, secure.";
+            return false;
+        }
+    }
+
+    it = values.find("adapter");
+    if (it != values.end() && it->second != "undefined") {
+        if (!ParseAdapter(it->second, &options->adapter)) {
+            error = "Option adapter should be 'auto' or the name (hci0), index or address of an available adapter.";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int BluetoothHelpers::ApplySocketOptions(int s, const socket_options_t *options) {
+    if (options->sendBufferSize > 0 &&
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF, &options->sendBufferSize, sizeof(options->sendBufferSize)) < 0) {
+        return -1;
+    }
+
+    if (options->receiveBufferSize > 0 &&
+        setsockopt(s, SOL_SOCKET, SO_RCVBUF, &options->receiveBufferSize, sizeof(options->receiveBufferSize)) < 0) {
+        return -1;
+    }
+
+    if (options->priority >= 0 &&
+        setsockopt(s, SOL_SOCKET, SO_PRIORITY, &options->priority, sizeof(options->priority)) < 0) {
+        return -1;
+    }
+
+    // the link mode has to be set before connect() or listen() to have effect
+    if (options->linkMode >= 0 &&
+        setsockopt(s, SOL_RFCOMM, RFCOMM_LM, &options->linkMode, sizeof(options->linkMode)) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int BluetoothHelpers::GetSocketInfo(int s, const socket_options_t *options, socket_info_t *info) {
+    memset(info, 0, sizeof(socket_info_t));
+
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    if (getpeername(s, (struct sockaddr *)&addr, &len) < 0) {
+        return -1;
+    }
+
+    if (addr.ss_family == AF_BLUETOOTH) {
+        struct sockaddr_rc *rc = (struct sockaddr_rc *)&addr;
+        ba2str(&rc->rc_bdaddr, info->remoteAddress);
+        info->channel = rc->rc_channel;
+
+        len = sizeof(addr);
+        if (getsockname(s, (struct sockaddr *)&addr, &len) == 0 && addr.ss_family == AF_BLUETOOTH) {
+            ba2str(&rc->rc_bdaddr, info->localAddress);
+        }
+    }
+
+    len = sizeof(info->sendBufferSize);
+    getsockopt(s, SOL_SOCKET, SO_SNDBUF, &info->sendBufferSize, &len);
+    len = sizeof(info->receiveBufferSize);
+    getsockopt(s, SOL_SOCKET, SO_RCVBUF, &info->receiveBufferSize, &len);
+    len = sizeof(info->priority);
+    getsockopt(s, SOL_SOCKET, SO_PRIORITY, &info->priority, &len);
+    len = sizeof(info->linkMode);
+    if (getsockopt(s, SOL_RFCOMM, RFCOMM_LM, &info->linkMode, &len) < 0) {
+        info->linkMode = -1;
+    }
+
+    // RFCOMM keeps the negotiated frame size to itself on most kernels, fall
+    // back to what was configured when BT_SNDMTU is not supported.
+    info->mtu = options->mtu;
+#ifdef BT_SNDMTU
+    uint16_t mtu = 0;
+    len = sizeof(mtu);
+    if (getsockopt(s, SOL_BLUETOOTH, BT_SNDMTU, &mtu, &len) == 0 && mtu > 0) {
+        info->mtu = mtu;
+    }
+#endif
+
+    return 0;
+}
+
+// Blocks until a non-blocking socket can take more data. Returns false with
+// errno set when the socket is in an error state or has been shut down.
+bool BluetoothHelpers::WaitWritable(int s) {
+    struct pollfd pfd;
+    pfd.fd = s;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    int result;
+    do {
+        result = poll(&pfd, 1, -1);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+        return false;
+    }
+
+    if (pfd.revents & POLLNVAL) {
+        errno = EBADF;
+        return false;
+    }
+
+    if (pfd.revents & POLLERR) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(s, SOL_SOCKET, SO_ERROR, &error, &len);
+        errno = error ? error : EIO;
+        return false;
+    }
+
+    if ((pfd.revents & POLLHUP) && !(pfd.revents & POLLOUT)) {
+        errno = EPIPE;
+        return false;
+    }
+
+    return true;
+}
+
+// Passes fd to the process at the other end of the unix socket `channel`.
+// The sender still owns its copy of fd and should close it afterwards.
+int BluetoothHelpers::SendFd(int channel, int fd) {
+    char byte = 0;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t result;
+    do {
+        result = sendmsg(channel, &msg, MSG_NOSIGNAL);
+    } while (result < 0 && errno == EINTR);
+
+    return result < 0 ? -1 : 0;
+}
+
+// Blocks until a file descriptor arrives on the unix socket `channel`.
+// Returns the new descriptor or -1 with errno set.
+int BluetoothHelpers::ReceiveFd(int channel) {
+    char byte;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    ssize_t result;
+    do {
+        result = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+        return -1;
+    }
+
+    if (result == 0) {
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+// Binds the socket to the address of adapter devId, so that connect() goes out
+// over that adapter instead of the first one.
+int BluetoothHelpers::BindAdapter(int s, int devId) {
+    struct sockaddr_rc addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.rc_family = AF_BLUETOOTH;
+    if (hci_devba(devId, &addr.rc_bdaddr) < 0) {
+        return -1;
+    }
+
+    return bind(s, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+struct adapter_sample_t {
+    uint64_t bytes;
+    double time;
+    double throughput;
+};
+
+static uv_once_t samplesOnce = UV_ONCE_INIT;
+static uv_mutex_t samplesMutex;
+static adapter_sample_t samples[HCI_MAX_DEV];
+
+static void initSamples() {
+    uv_mutex_init(&samplesMutex);
+    memset(samples, 0, sizeof(samples));
+}
+
+// Turns the kernel byte counters of the adapter into a rate. Connects run on
+// worker threads, so the previous samples are shared under a lock. Samples
+// taken less than half a second apart keep the previous rate.
+static double sampleThroughput(int devId, uint64_t bytes) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double time = now.tv_sec + now.tv_nsec / 1e9;
+
+    uv_once(&samplesOnce, initSamples);
+    uv_mutex_lock(&samplesMutex);
+
+    adapter_sample_t *sample = &samples[devId];
+    if (sample->time == 0 || bytes < sample->bytes) {
+        // first sample or the adapter was reset
+        sample->bytes = bytes;
+        sample->time = time;
+    } else if (time - sample->time >= 0.5) {
+        sample->throughput = (bytes - sample->bytes) / (time - sample->time);
+        sample->bytes = bytes;
+        sample->time = time;
+    }
+    double throughput = sample->throughput;
+
+    uv_mutex_unlock(&samplesMutex);
+    return throughput;
+}
+
+// Lists the adapters that are up with their active ACL links and traffic.
+int BluetoothHelpers::GetAdapterStats(std::vector<adapter_stats_t> &adapters) {
+    adapters.clear();
+
+    int ctl = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+    if (ctl < 0) {
+        return -1;
+    }
+
+    char devBuffer[sizeof(struct hci_dev_list_req) + HCI_MAX_DEV * sizeof(struct hci_dev_req)];
+    struct hci_dev_list_req *devList = (struct hci_dev_list_req *)devBuffer;
+    memset(devBuffer, 0, sizeof(devBuffer));
+    devList->dev_num = HCI_MAX_DEV;
+
+    if (ioctl(ctl, HCIGETDEVLIST, (void *)devList) < 0) {
+        close(ctl);
+        return -1;
+    }
+
+    // room for a few more than the active links, e.g. links being set up
+    const int maxConnections = 2 * ADAPTER_MAX_LINKS;
+    char connBuffer[sizeof(struct hci_conn_list_req) + maxConnections * sizeof(struct hci_conn_info)];
+    struct hci_conn_list_req *connList = (struct hci_conn_list_req *)connBuffer;
+
+    for (int i = 0; i < devList->dev_num; i++) {
+        struct hci_dev_info devInfo;
+        memset(&devInfo, 0, sizeof(devInfo));
+        devInfo.dev_id = devList->dev_req[i].dev_id;
+        if (devInfo.dev_id >= HCI_MAX_DEV || ioctl(ctl, HCIGETDEVINFO, (void *)&devInfo) < 0 ||
+            !hci_test_bit(HCI_UP, &devInfo.flags)) {
+            continue;
+        }
+
+        adapter_stats_t stats;
+        stats.devId = devInfo.dev_id;
+        ba2str(&devInfo.bdaddr, stats.address);
+        stats.links = 0;
+        stats.throughput = sampleThroughput(devInfo.dev_id,
+            (uint64_t)devInfo.stat.byte_rx + devInfo.stat.byte_tx);
+
+        memset(connBuffer, 0, sizeof(connBuffer));
+        connList->dev_id = devInfo.dev_id;
+        connList->conn_num = maxConnections;
+        if (ioctl(ctl, HCIGETCONNLIST, (void *)connList) == 0) {
+            for (int j = 0; j < connList->conn_num; j++) {
+                if (connList->conn_info[j].type == ACL_LINK) {
+                    stats.links++;
+                }
+            }
+        }
+
+        adapters.push_back(stats);
+    }
+
+    close(ctl);
+    return 0;
+}
+
+// The placement policy: the adapter with the lowest load, where the load is
+// the larger of the share of its link slots in use and the share of its air
+// budget in use. Full adapters are skipped. Returns the index in `adapters`
+// or -1 when every adapter is full.
+int BluetoothHelpers::ChooseAdapter(const std::vector<adapter_stats_t> &adapters) {
+    int best = -1;
+    double bestLoad = 0;
+
+    for (size_t i = 0; i < adapters.size(); i++) {
+        if (adapters[i].links >= ADAPTER_MAX_LINKS) {
+            continue;
+        }
+
+        double linkLoad = (double)adapters[i].links / ADAPTER_MAX_LINKS;
+        double airLoad = adapters[i].throughput / ADAPTER_AIR_BUDGET;
+        double load = linkLoad > airLoad ? linkLoad : airLoad;
+
+        // on equal load the adapter with fewer links wins, then the first one
+        if (best < 0 || load < bestLoad ||
+            (load == bestLoad && adapters[i].links < adapters[best].links)) {
+            best = i;
+            bestLoad = load;
+        }
+    }
+
+    return best;
+}
+
+int BluetoothHelpers::OpenControl(control_channel_t *control) {
+    control->commands = 0;
+    control->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return control->fd < 0 ? -1 : 0;
+}
+
+int BluetoothHelpers::SignalControl(control_channel_t *control, int command) {
+    if (control->fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // publish the command before the wake-up, a reader that sees the
+    // eventfd readable always finds its bit
+    control->commands.fetch_or(command);
+    return eventfd_write(control->fd, 1);
+}
+
+int BluetoothHelpers::TakeControl(control_channel_t *control) {
+    // drain the counter first, a signal racing with us then leaves the
+    // eventfd readable and the reader wakes up once more for nothing
+    eventfd_t value;
+    eventfd_read(control->fd, &value);
+    return control->commands.exchange(0);
+}
+
+void BluetoothHelpers::CloseControl(control_channel_t *control) {
+    if (control->fd >= 0) {
+        close(control->fd);
+        control->fd = -1;
+    }
+}
+
+// The wheel is only touched from the event loop, each module has its own
+static ngx_queue_t idleWheel[IDLE_WHEEL_SLOTS];
+static uv_timer_t idleTicker;
+static size_t idleCursor = 0;
+static int idleCount = 0;
+static bool idleReady = false;
+
+static void scheduleIdleTimer(idle_timer_t *timer, uint64_t now, uint64_t deadline) {
+    const uint64_t tick = (uint64_t) IDLE_WHEEL_TICK * 1000000;
+    uint64_t ticks = deadline > now ? (deadline - now + tick - 1) / tick : 1;
+    if (ticks < 1) {
+        ticks = 1;
+    } else if (ticks > IDLE_WHEEL_SLOTS - 1) {
+        ticks = IDLE_WHEEL_SLOTS - 1;
+    }
+
+    ngx_queue_insert_tail(&idleWheel[(idleCursor + ticks) % IDLE_WHEEL_SLOTS], &timer->queue);
+}
+
+static void onIdleTick(uv_timer_t *handle) {
+    idleCursor = (idleCursor + 1) % IDLE_WHEEL_SLOTS;
+    ngx_queue_t *slot = &idleWheel[idleCursor];
+    uint64_t now = uv_hrtime();
+
+    // timers are never scheduled into the current slot, so this ends
+    while (!ngx_queue_empty(slot)) {
+        ngx_queue_t *head = ngx_queue_head(slot);
+        idle_timer_t *timer = ngx_queue_data(head, idle_timer_t, queue);
+        ngx_queue_remove(head);
+        ngx_queue_init(head);
+
+        // a read may have landed after we took the time
+        uint64_t last = timer->lastActivity.load(std::memory_order_relaxed);
+        if (last > now) {
+            last = now;
+        }
+
+        if (timer->timeout > 0 && now - last >= timer->timeout) {
+            BluetoothHelpers::StopIdleTimer(timer);
+            timer->expired(timer);
+            continue;
+        }
+
+        uint64_t deadline = timer->timeout > 0 ? last + timer->timeout : UINT64_MAX;
+        if (timer->keepalive > 0) {
+            uint64_t since = last > timer->lastProbe ? last : timer->lastProbe;
+            if (now - since >= timer->keepalive) {
+                timer->lastProbe = since = now;
+                timer->probe(timer);
+                if (!timer->active) {
+                    continue;
+                }
+            }
+            if (since + timer->keepalive < deadline) {
+                deadline = since + timer->keepalive;
+            }
+        }
+
+        scheduleIdleTimer(timer, now, deadline);
+    }
+}
+
+void BluetoothHelpers::InitIdleTimer(idle_timer_t *timer, void *data, void (*expired)(idle_timer_t *), void (*probe)(idle_timer_t *)) {
+    ngx_queue_init(&timer->queue);
+    timer->lastActivity = 0;
+    timer->lastProbe = 0;
+    timer->timeout = 0;
+    timer->keepalive = 0;
+    timer->active = false;
+    timer->expired = expired;
+    timer->probe = probe;
+    timer->data = data;
+}
+
+void BluetoothHelpers::StartIdleTimer(idle_timer_t *timer, const socket_options_t *options) {
+    if (timer->active || (options->idleTimeout <= 0 && options->keepaliveInterval <= 0)) {
+        return;
+    }
+
+    if (!idleReady) {
+        for (size_t i = 0; i < IDLE_WHEEL_SLOTS; i++) {
+            ngx_queue_init(&idleWheel[i]);
+        }
+        uv_timer_init(uv_default_loop(), &idleTicker);
+        // connections keep the process alive, the wheel does not
+        uv_unref(reinterpret_cast<uv_handle_t *>(&idleTicker));
+        idleReady = true;
+    }
+
+    uint64_t now = uv_hrtime();
+    timer->timeout = (uint64_t) options->idleTimeout * 1000000;
+    timer->keepalive = (uint64_t) options->keepaliveInterval * 1000000;
+    timer->lastActivity = now;
+    timer->lastProbe = now;
+    timer->active = true;
+
+    uint64_t first = timer->timeout > 0 ? timer->timeout : timer->keepalive;
+    if (timer->keepalive > 0 && timer->keepalive < first) {
+        first = timer->keepalive;
+    }
+    scheduleIdleTimer(timer, now, now + first);
+
+    if (idleCount++ == 0) {
+        uv_timer_start(&idleTicker, onIdleTick, IDLE_WHEEL_TICK, IDLE_WHEEL_TICK);
+    }
+}
+
+void BluetoothHelpers::StopIdleTimer(idle_timer_t *timer) {
+    if (!timer->active) {
+        return;
+    }
+
+    // a timer that is being looked at by the tick has already left its slot
+    if (!ngx_queue_empty(&timer->queue)) {
+        ngx_queue_remove(&timer->queue);
+    }
+    ngx_queue_init(&timer->queue);
+    timer->active = false;
+
+    if (--idleCount == 0) {
+        uv_timer_stop(&idleTicker);
+    }
+}
+
+void BluetoothHelpers::TouchIdleTimer(idle_timer_t *timer) {
+    // called from the reading thread, the wheel picks it up on its next look
+    timer->lastActivity.store(uv_hrtime(), std::memory_order_relaxed);
+}
+
+#define DEVICE_CACHE_VERSION 1
+
+static_assert(sizeof(device_cache_entry_t) == 280, "the cache file record layout changed");
+
+// Inquiries run on worker threads, possibly on several adapters at once
+static uv_once_t cacheOnce = UV_ONCE_INIT;
+static uv_mutex_t cacheMutex;
+static std::map<uint64_t, device_cache_entry_t> cache;
+
+static void initCache() {
+    uv_mutex_init(&cacheMutex);
+}
+
+static uint64_t cacheKey(const uint8_t bdaddr[6]) {
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) {
+        key = (key << 8) | bdaddr[i];
+    }
+    return key;
+}
+
+// Called with cacheMutex held. A sighting without a name keeps the name
+// read earlier.
+static void storeEntry(const device_cache_entry_t &entry) {
+    uint64_t key = cacheKey(entry.bdaddr);
+    std::map<uint64_t, device_cache_entry_t>::iterator found = cache.find(key);
+
+    if (found == cache.end()) {
+        if (cache.size() >= DEVICE_CACHE_MAX) {
+            std::map<uint64_t, device_cache_entry_t>::iterator oldest = cache.begin();
+            for (std::map<uint64_t, device_cache_entry_t>::iterator it = cache.begin(); it != cache.end(); ++it) {
+                if (it->second.seen < oldest->second.seen) {
+                    oldest = it;
+                }
+            }
+            cache.erase(oldest);
+        }
+        cache[key] = entry;
+        return;
+    }
+
+    device_cache_entry_t &current = found->second;
+    if (entry.seen < current.seen) {
+        return;
+    }
+    device_cache_entry_t merged = entry;
+    if (merged.named == 0 && current.named != 0) {
+        merged.named = current.named;
+        memcpy(merged.name, current.name, sizeof(merged.name));
+    }
+    current = merged;
+}
+
+bool BluetoothHelpers::LookupDevice(const uint8_t bdaddr[6], device_cache_entry_t *entry) {
+    uv_once(&cacheOnce, initCache);
+    uv_mutex_lock(&cacheMutex);
+
+    std::map<uint64_t, device_cache_entry_t>::iterator found = cache.find(cacheKey(bdaddr));
+    bool result = (found != cache.end());
+    if (result) {
+        *entry = found->second;
+    }
+
+    uv_mutex_unlock(&cacheMutex);
+    return result;
+}
+
+void BluetoothHelpers::StoreDevice(const device_cache_entry_t &entry) {
+    uv_once(&cacheOnce, initCache);
+    uv_mutex_lock(&cacheMutex);
+    storeEntry(entry);
+    uv_mutex_unlock(&cacheMutex);
+}
+
+std::vector<device_cache_entry_t> BluetoothHelpers::ListDevices() {
+    uv_once(&cacheOnce, initCache);
+    uv_mutex_lock(&cacheMutex);
+
+    std::vector<device_cache_entry_t> result;
+    result.reserve(cache.size());
+    for (std::map<uint64_t, device_cache_entry_t>::iterator it = cache.begin(); it != cache.end(); ++it) {
+        result.push_back(it->second);
+    }
+
+    uv_mutex_unlock(&cacheMutex);
+    return result;
+}
+
+// Merges the devices in the file at `path` into the cache, the newer
+// sighting of a device wins. A missing file is an empty cache, a file
+// written by another version of the layout is ignored. Returns the number
+// of devices read, -1 with errno set when the file cannot be read.
+int BluetoothHelpers::LoadDeviceCache(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t) st.st_size < sizeof(device_cache_header_t)) {
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const device_cache_header_t *header = (const device_cache_header_t *) map;
+    const device_cache_entry_t *entries = (const device_cache_entry_t *) (header + 1);
+    int count = 0;
+    if (memcmp(header->magic, "BTDC", 4) == 0 && header->version == DEVICE_CACHE_VERSION &&
+            header->entrySize == sizeof(device_cache_entry_t) &&
+            header->count <= (st.st_size - sizeof(device_cache_header_t)) / sizeof(device_cache_entry_t)) {
+        count = header->count;
+
+        uv_once(&cacheOnce, initCache);
+        uv_mutex_lock(&cacheMutex);
+        for (int i = 0; i < count; i++) {
+            device_cache_entry_t entry = entries[i];
+            entry.name[sizeof(entry.name) - 1] = '\0';
+            storeEntry(entry);
+        }
+        uv_mutex_unlock(&cacheMutex);
+    }
+
+    munmap(map, st.st_size);
+    return count;
+}
+
+// Writes `iov` to a temporary file next to `path` and moves it in place, so
+// a reader never sees half a file. Returns -1 with errno set on failure.
+static int replaceFile(const std::string &path, struct iovec *iov, int count) {
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0 || (size_t) written != total || fsync(fd) < 0) {
+        int err = (written < 0) ? errno : EIO;
+        close(fd);
+        unlink(temporary.c_str());
+        errno = err;
+        return -1;
+    }
+    close(fd);
+
+    if (rename(temporary.c_str(), path.c_str()) < 0) {
+        int err = errno;
+        unlink(temporary.c_str());
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the cache to `path`, replacing the file as a whole. Returns the
+// number of devices written, -1 with errno set on failure.
+int BluetoothHelpers::SaveDeviceCache(const std::string &path) {
+    std::vector<device_cache_entry_t> entries = ListDevices();
+
+    device_cache_header_t header;
+    memcpy(header.magic, "BTDC", 4);
+    header.version = DEVICE_CACHE_VERSION;
+    header.count = entries.size();
+    header.entrySize = sizeof(device_cache_entry_t);
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = entries.empty() ? NULL : &entries[0];
+    iov[1].iov_len = entries.size() * sizeof(device_cache_entry_t);
+
+    if (replaceFile(path, iov, 2) < 0) {
+        return -1;
+    }
+    return entries.size();
+}
+
+#define SERVICE_CACHE_VERSION 1
+
+static_assert(sizeof(service_cache_record_t) == 24, "the service cache file record layout changed");
+
+// Service searches run on worker threads like the inquiries
+static uv_once_t servicesOnce = UV_ONCE_INIT;
+static uv_mutex_t servicesMutex;
+static std::map<uint64_t, service_cache_entry_t> services;
+
+static void initServices() {
+    uv_mutex_init(&servicesMutex);
+}
+
+// Called with servicesMutex held. An older search never replaces a newer one.
+static void storeServices(const service_cache_entry_t &entry) {
+    uint64_t key = cacheKey(entry.bdaddr);
+    std::map<uint64_t, service_cache_entry_t>::iterator found = services.find(key);
+
+    if (found == services.end()) {
+        if (services.size() >= SERVICE_CACHE_MAX) {
+            std::map<uint64_t, service_cache_entry_t>::iterator oldest = services.begin();
+            for (std::map<uint64_t, service_cache_entry_t>::iterator it = services.begin(); it != services.end(); ++it) {
+                if (it->second.searched < oldest->second.searched) {
+                    oldest = it;
+                }
+            }
+            services.erase(oldest);
+        }
+        services[key] = entry;
+    } else if (entry.searched >= found->second.searched) {
+        found->second = entry;
+    }
+}
+
+bool BluetoothHelpers::LookupServices(const uint8_t bdaddr[6], service_cache_entry_t *entry) {
+    uv_once(&servicesOnce, initServices);
+    uv_mutex_lock(&servicesMutex);
+
+    std::map<uint64_t, service_cache_entry_t>::iterator found = services.find(cacheKey(bdaddr));
+    bool result = (found != services.end());
+    if (result) {
+        *entry = found->second;
+    }
+
+    uv_mutex_unlock(&servicesMutex);
+    return result;
+}
+
+void BluetoothHelpers::StoreServices(const service_cache_entry_t &entry) {
+    uv_once(&servicesOnce, initServices);
+    uv_mutex_lock(&servicesMutex);
+    storeServices(entry);
+    uv_mutex_unlock(&servicesMutex);
+}
+
+// Merges the devices in the file at `path` into the service cache, the
+// newer search of a device wins. A missing file is an empty cache, a file
+// of another version is ignored and a record running past the end of the
+// file ends it. Returns the number of devices read, -1 with errno set when
+// the file cannot be read.
+int BluetoothHelpers::LoadServiceCache(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t) st.st_size < sizeof(service_cache_header_t)) {
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const service_cache_header_t *header = (const service_cache_header_t *) map;
+    int count = 0;
+    if (memcmp(header->magic, "BTSC", 4) == 0 && header->version == SERVICE_CACHE_VERSION) {
+        const uint8_t *data = (const uint8_t *) map;
+        size_t offset = sizeof(service_cache_header_t);
+
+        uv_once(&servicesOnce, initServices);
+        uv_mutex_lock(&servicesMutex);
+        for (uint32_t i = 0; i < header->count && offset + sizeof(service_cache_record_t) <= (size_t) st.st_size; i++) {
+            service_cache_record_t record;
+            memcpy(&record, data + offset, sizeof(record));
+            offset += sizeof(record);
+            if (record.length > st.st_size - offset) {
+                break;
+            }
+
+            service_cache_entry_t entry;
+            entry.searched = record.searched;
+            memcpy(entry.bdaddr, record.bdaddr, sizeof(entry.bdaddr));
+            entry.records.assign(data + offset, data + offset + record.length);
+            offset += record.length;
+
+            storeServices(entry);
+            count++;
+        }
+        uv_mutex_unlock(&servicesMutex);
+    }
+
+    munmap(map, st.st_size);
+    return count;
+}
+
+// Writes the service cache to `path`, replacing the file as a whole.
+// Returns the number of devices written, -1 with errno set on failure.
+int BluetoothHelpers::SaveServiceCache(const std::string &path) {
+    uv_once(&servicesOnce, initServices);
+    uv_mutex_lock(&servicesMutex);
+    std::vector<service_cache_entry_t> entries;
+    entries.reserve(services.size());
+    for (std::map<uint64_t, service_cache_entry_t>::iterator it = services.begin(); it != services.end(); ++it) {
+        entries.push_back(it->second);
+    }
+    uv_mutex_unlock(&servicesMutex);
+
+    service_cache_header_t header;
+    memcpy(header.magic, "BTSC", 4);
+    header.version = SERVICE_CACHE_VERSION;
+    header.count = entries.size();
+
+    // the records differ in length, so the file is put together in memory
+    std::vector<uint8_t> buffer;
+    for (size_t i = 0; i < entries.size(); i++) {
+        service_cache_record_t record;
+        memset(&record, 0, sizeof(record));
+        record.searched = entries[i].searched;
+        record.length = entries[i].records.size();
+        memcpy(record.bdaddr, entries[i].bdaddr, sizeof(record.bdaddr));
+
+        const uint8_t *bytes = (const uint8_t *) &record;
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(record));
+        buffer.insert(buffer.end(), entries[i].records.begin(), entries[i].records.end());
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = buffer.empty() ? NULL : &buffer[0];
+    iov[1].iov_len = buffer.size();
+
+    if (replaceFile(path, iov, 2) < 0) {
+        return -1;
+    }
+    return entries.size();
+}
+
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2012-2013, Eelco Cramer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NODE_BTSP_SRC_LINUX_BLUETOOTH_HELPERS_H
+#define NODE_BTSP_SRC_LINUX_BLUETOOTH_HELPERS_H
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <uv.h>
+#include "ngx-queue.h"
+
+// The RFCOMM frame size the kernel starts from before negotiation. RFCOMM
+// sockets do not expose the negotiated value, so this is what we report
+// unless the caller tells us better.
+#define RFCOMM_DEFAULT_MTU 127
+
+// Values of socket_options_t.adapter that do not name an adapter
+#define ADAPTER_ANY -1      // leave the choice to the kernel, which takes the first adapter
+#define ADAPTER_AUTO -2     // pick the least loaded adapter when connecting
+
+// A BR/EDR adapter runs at most 7 active ACL links
+#define ADAPTER_MAX_LINKS 7
+
+// Rough RFCOMM throughput in bytes per second one adapter can sustain over
+// all of its links. Used to weigh observed traffic against the link count.
+#define ADAPTER_AIR_BUDGET 200000
+
+// Commands the main thread hands to a reader blocked in pselect
+#define CONTROL_CLOSE 0x1
+#define CONTROL_DISCONNECT 0x2
+#define CONTROL_DETACH 0x4
+#define CONTROL_TIMEOUT 0x8
+
+// Resolution and reach of the idle timer wheel. Deadlines further out than
+// the wheel reaches are parked in the last slot and looked at again from there.
+#define IDLE_WHEEL_TICK 250 // ms
+#define IDLE_WHEEL_SLOTS 64
+
+// Wakes a blocked reader without a string protocol. Commands are bits that
+// accumulate until the reader takes them, so signals that arrive together
+// are all seen and neither side allocates.
+struct control_channel_t {
+    int fd;                     // eventfd, readable while commands are pending, -1 when closed
+    std::atomic<int> commands;  // CONTROL_* bits not yet taken by a reader
+};
+
+struct socket_options_t {
+    int sendBufferSize;     // SO_SNDBUF, 0 keeps the kernel default
+    int receiveBufferSize;  // SO_RCVBUF, 0 keeps the kernel default
+    int priority;           // SO_PRIORITY, -1 keeps the kernel default
+    int linkMode;           // RFCOMM_LM flags, -1 keeps the kernel default
+    int mtu;                // MTU to report when the kernel cannot tell us
+    int adapter;            // HCI device id to bind to, or ADAPTER_ANY / ADAPTER_AUTO
+    int idleTimeout;        // ms without incoming data before the connection is dropped, 0 for never
+    int keepaliveInterval;  // ms without incoming data between keepalive probes, 0 for none
+};
+
+// One connection on the idle timer wheel. Reading threads only store the
+// time of the last incoming data; the wheel compares it with the deadlines
+// on the event loop when the slot of the connection comes around.
+struct idle_timer_t {
+    ngx_queue_t queue;                  // slot on the wheel while active
+    std::atomic<uint64_t> lastActivity; // uv_hrtime() of the last incoming data
+    uint64_t lastProbe;
+    uint64_t timeout;                   // ns, 0 never expires
+    uint64_t keepalive;                 // ns, 0 never probes
+    bool active;
+    void (*expired)(idle_timer_t *timer);   // off the wheel by the time this is called
+    void (*probe)(idle_timer_t *timer);
+    void *data;
+};
+
+struct socket_info_t {
+    char remoteAddress[19];
+    char localAddress[19];  // the adapter the connection runs over
+    int channel;
+    int mtu;
+    int sendBufferSize;
+    int receiveBufferSize;
+    int priority;
+    int linkMode;
+};
+
+// Devices kept in the device cache, the least recently seen go first
+#define DEVICE_CACHE_MAX 4096
+#define DEVICE_CACHE_NO_RSSI 127
+
+// A device seen by an inquiry. This is also the record layout of the cache
+// file, which is a device_cache_header_t followed by `count` of these, so
+// the fields are laid out without padding.
+struct device_cache_entry_t {
+    uint64_t seen;              // ms since the epoch the device last answered an inquiry
+    uint64_t named;             // ms since the epoch its name was read, 0 when it has none
+    uint8_t bdaddr[6];
+    uint8_t deviceClass[3];
+    int8_t rssi;                // dBm, DEVICE_CACHE_NO_RSSI when unknown
+    uint16_t clockOffset;
+    uint8_t pscanRepMode;
+    uint8_t reserved;
+    char name[250];
+};
+
+struct device_cache_header_t {
+    char magic[4];              // "BTDC"
+    uint32_t version;
+    uint32_t count;
+    uint32_t entrySize;         // sizeof(device_cache_entry_t) of the writer
+};
+
+// Devices kept in the service cache, the least recently searched go first
+#define SERVICE_CACHE_MAX 1024
+
+// The service records of a device as its last full service search returned
+// them: the attribute lists of all records, in the sequence SDP sends them.
+struct service_cache_entry_t {
+    uint64_t searched;              // ms since the epoch of the search
+    uint8_t bdaddr[6];
+    std::vector<uint8_t> records;
+};
+
+// The service cache file is a service_cache_header_t followed by `count`
+// of these, each followed by `length` bytes of records
+struct service_cache_record_t {
+    uint64_t searched;
+    uint32_t length;
+    uint8_t bdaddr[6];
+    uint8_t reserved[6];
+};
+
+struct service_cache_header_t {
+    char magic[4];              // "BTSC"
+    uint32_t version;
+    uint32_t count;
+};
+
+struct adapter_stats_t {
+    int devId;
+    char address[19];
+    int links;              // active ACL links
+    double throughput;      // bytes per second sent and received since the previous sample
+};
+
+class BluetoothHelpers {
+    public:
+        static void InitSocketOptions(socket_options_t *options);
+        static bool ParseSocketOptions(std::map<std::string, std::string> &values, socket_options_t *options, std::string &error);
+        static int ApplySocketOptions(int s, const socket_options_t *options);
+        static int GetSocketInfo(int s, const socket_options_t *options, socket_info_t *info);
+        static int SendFd(int channel, int fd);
+        static int ReceiveFd(int channel);
+        static bool WaitWritable(int s);
+        static bool ParseAdapter(const std::string &value, int *adapter);
+        static int BindAdapter(int s, int devId);
+        static int GetAdapterStats(std::vector<adapter_stats_t> &adapters);
+        static int ChooseAdapter(const std::vector<adapter_stats_t> &adapters);
+        static int OpenControl(control_channel_t *control);
+        static int SignalControl(control_channel_t *control, int command);
+        static int TakeControl(control_channel_t *control);
+        static void CloseControl(control_channel_t *control);
+        static void InitIdleTimer(idle_timer_t *timer, void *data, void (*expired)(idle_timer_t *), void (*probe)(idle_timer_t *));
+        static void StartIdleTimer(idle_timer_t *timer, const socket_options_t *options);
+        static void StopIdleTimer(idle_timer_t *timer);
+        static void TouchIdleTimer(idle_timer_t *timer);
+        static bool LookupDevice(const uint8_t bdaddr[6], device_cache_entry_t *entry);
+        static void StoreDevice(const device_cache_entry_t &entry);
+        static std::vector<device_cache_entry_t> ListDevices();
+        static int LoadDeviceCache(const std::string &path);
+        static int SaveDeviceCache(const std::string &path);
+        static bool LookupServices(const uint8_t bdaddr[6], service_cache_entry_t *entry);
+        static void StoreServices(const service_cache_entry_t &entry);
+        static int LoadServiceCache(const std::string &path);
+        static int SaveServiceCache(const std::string &path);
+};
+
+#endif
@@ -16,7 +16,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <node_object_wrap.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
 #include "DeviceINQ.h"
+#include "BluetoothHelpers.h"
 
 extern "C"{
     #include <stdio.h>
@@ -29,6 +35,7 @@ extern "C"{
     #include <sys/poll.h>
     #include <sys/ioctl.h>
     #include <sys/socket.h>
+    #include <dirent.h>
     #include <assert.h>
 
 
@@ -44,85 +51,187 @@ using namespace std;
 using namespace node;
 using namespace v8;
 
-void DeviceINQ::EIO_SdpSearch(uv_work_t *req) {
-    sdp_baton_t *baton = static_cast<sdp_baton_t *>(req->data);
+// How long a service search may take from the connect to the last answer
+#define SDP_SEARCH_TIMEOUT 20000
 
-    // default, no channel is found
-    baton->channelID = -1;
+// What the SDP library hands to the notify callback of an asynchronous search
+struct sdp_search_t {
+    bool done;
+    bool failed;
+    std::vector<uint8_t> response;  // the attribute lists of all matching records
+};
+
+static void sdpSearchDone(uint8_t type, uint16_t status, uint8_t *rsp, size_t size, void *udata) {
+    sdp_search_t *search = static_cast<sdp_search_t *>(udata);
+    search->done = true;
+    search->failed = type == SDP_ERROR_RSP || status != 0;
+    if (!search->failed && rsp != NULL) {
+        // the buffer belongs to the library and is gone after the callback
+        search->response.assign(rsp, rsp + size);
+    }
+}
+
+static int64_t monotonicClock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint64_t wallClock() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Waits for `events` on the SDP socket. Returns 1 when they are there, 0 on
+// a timeout or when the socket broke down and -1 when the search is cancelled.
+static int waitSdpSocket(int fd, short events, control_channel_t *control, int64_t deadline) {
+    for (;;) {
+        int remaining = (int) (deadline - monotonicClock());
+        if (remaining <= 0) {
+            return 0;
+        }
+
+        struct pollfd p[2];
+        p[0].fd = fd;
+        p[0].events = events;
+        p[0].revents = 0;
+        p[1].fd = control->fd;
+        p[1].events = POLLIN;
+        p[1].revents = 0;
+
+        int ready = poll(p, 2, remaining);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        if (p[1].revents & POLLIN) {
+            if (BluetoothHelpers::TakeControl(control) & CONTROL_CLOSE) {
+                return -1;
+            }
+        }
+        if (p[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            return events == POLLOUT ? 1 : 0;  // a failed connect shows in the socket error
+        }
+        if (p[0].revents & events) {
+            return 1;
+        }
+    }
+}
 
+// Searches the SDP server of `address` for the records that hold `uuid`
+// and hands back their attribute lists as SDP sends them. The search runs
+// without blocking, so a cancel from the event loop aborts the session at
+// once instead of waiting for the device to answer. Returns -1 when the
+// device cannot be reached, does not answer in time or the search is
+// cancelled, which sets `cancelled`.
+static int searchServices(const char *address, uint16_t uuid, control_channel_t *control,
+        std::vector<uint8_t> *response, bool *cancelled) {
     uuid_t svc_uuid;
     bdaddr_t target;
     bdaddr_t source = { { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } };
-    sdp_list_t *response_list = NULL, *search_list, *attrid_list;
+    sdp_list_t *search_list, *attrid_list;
     sdp_session_t *session = 0;
+    int64_t deadline = monotonicClock() + SDP_SEARCH_TIMEOUT;
 
-    str2ba(baton->address, &target);
-
-    // connect to the SDP server running on the remote machine
-    // session = sdp_connect(BDADDR_ANY, &target, SDP_RETRY_IF_BUSY);
-    session = sdp_connect(&source, &target, SDP_RETRY_IF_BUSY);
+    *cancelled = false;
+    str2ba(address, &target);
 
+    // connect to the SDP server running on the remote machine, the library
+    // does not retry a busy server on a non blocking session
+    session = sdp_connect(&source, &target, SDP_NON_BLOCKING);
     if (!session) {
-        return;
+        return -1;
+    }
+
+    int sock = sdp_get_socket(session);
+    int ready = waitSdpSocket(sock, POLLOUT, control, deadline);
+    if (ready <= 0 || sdp_get_error(session) != 0) {
+        *cancelled = ready < 0;
+        sdp_close(session);
+        return -1;
     }
 
+    sdp_search_t search;
+    search.done = false;
+    search.failed = false;
+    sdp_set_notify(session, sdpSearchDone, &search);
+
     // specify the UUID of the application we're searching for
-    sdp_uuid16_create(&svc_uuid, SERIAL_PORT_PROFILE_ID);
+    sdp_uuid16_create(&svc_uuid, uuid);
     search_list = sdp_list_append(NULL, &svc_uuid);
 
     // specify that we want a list of all the matching applications' attributes
     uint32_t range = 0x0000ffff;
     attrid_list = sdp_list_append(NULL, &range);
 
-    // get a list of service records that have the serial port UUID
-    sdp_service_search_attr_req( session, search_list, SDP_ATTR_REQ_RANGE, attrid_list, &response_list);
+    // the answer may take several continuation requests that sdp_process sends
+    int sent = sdp_service_search_attr_async(session, search_list, SDP_ATTR_REQ_RANGE, attrid_list);
+    sdp_list_free(search_list, 0);
+    sdp_list_free(attrid_list, 0);
+
+    while (sent == 0 && !search.done) {
+        ready = waitSdpSocket(sock, POLLIN, control, deadline);
+        if (ready <= 0) {
+            *cancelled = ready < 0;
+            break;
+        }
+        if (sdp_process(session) < 0 && !search.done) {
+            break;
+        }
+    }
+    sdp_close(session);
 
-    sdp_list_t *r = response_list;
+    if (!search.done || search.failed) {
+        return -1;
+    }
+    response->swap(search.response);
+    return 0;
+}
 
-    // go through each of the service records
-    for (; r; r = r->next ) {
-        sdp_record_t *rec = (sdp_record_t*) r->data;
-        sdp_list_t *proto_list;
-
-        // get a list of the protocol sequences
-        if( sdp_get_access_protos( rec, &proto_list ) == 0 ) {
-            sdp_list_t *p = proto_list;
-
-            // go through each protocol sequence
-            for( ; p ; p = p->next ) {
-                sdp_list_t *pds = (sdp_list_t*)p->data;
-
-                // go through each protocol list of the protocol sequence
-                for( ; pds ; pds = pds->next ) {
-
-                    // check the protocol attributes
-                    sdp_data_t *d = (sdp_data_t*)pds->data;
-                    int proto = 0;
-                    for( ; d; d = d->next ) {
-                        switch( d->dtd ) {
-                            case SDP_UUID16:
-                            case SDP_UUID32:
-                            case SDP_UUID128:
-                                proto = sdp_uuid_to_proto( &d->val.uuid );
-                                break;
-                            case SDP_UINT8:
-                                if( proto == RFCOMM_UUID ) {
-                                    baton->channelID = d->val.int8;
-                                    return; // stop if channel is found
-                                }
-                                break;
-                        }
-                    }
-                }
-                sdp_list_free((sdp_list_t*)p->data, 0 );
+// Serial port records in the form the service record parser hands out
+#define SERIAL_PORT_UUID "00001101-0000-1000-8000-00805f9b34fb"
+
+// How long a full service search answers the serial port search
+#define SERVICE_DEFAULT_CACHE_TTL 3600000
+
+void DeviceINQ::EIO_SdpSearch(uv_work_t *req) {
+    sdp_baton_t *baton = static_cast<sdp_baton_t *>(req->data);
+
+    // default, no channel is found
+    baton->channelID = -1;
+
+    // a recent discoverServices() of the device has its serial port records
+    bdaddr_t target;
+    str2ba(baton->address, &target);
+    service_cache_entry_t cached;
+    std::vector<service_record_t> records;
+    if (BluetoothHelpers::LookupServices(target.b, &cached) && wallClock() - cached.searched <= SERVICE_DEFAULT_CACHE_TTL) {
+        if (!cached.records.empty()) {
+            parseServiceRecords(&cached.records[0], cached.records.size(), &records);
+        }
+        for (size_t i = 0; i < records.size() && baton->channelID < 0; i++) {
+            if (std::find(records[i].uuids.begin(), records[i].uuids.end(), SERIAL_PORT_UUID) != records[i].uuids.end()) {
+                baton->channelID = records[i].channel;
             }
-            sdp_list_free(proto_list, 0 );
         }
+        return;
+    }
 
-        sdp_record_free( rec );
+    // get a list of service records that have the serial port UUID
+    std::vector<uint8_t> response;
+    if (searchServices(baton->address, SERIAL_PORT_PROFILE_ID, baton->control, &response, &baton->cancelled) < 0 ||
+            response.empty()) {
+        return;
     }
+    parseServiceRecords(&response[0], response.size(), &records);
 
-    sdp_close(session);
+    // go through each of the service records
+    for (size_t i = 0; i < records.size() && baton->channelID < 0; i++) {
+        baton->channelID = records[i].channel;
+    }
 }
 
 void DeviceINQ::EIO_AfterSdpSearch(uv_work_t *req) {
@@ -132,12 +241,17 @@ void DeviceINQ::EIO_AfterSdpSearch(uv_work_t *req) {
 
     Nan::TryCatch try_catch;
 
+    baton->inquire->EndOperation(baton->operation);
+    BluetoothHelpers::CloseControl(baton->control);
+    delete baton->control;
+
     Local<Value> argv[] = {
-        Nan::New(baton->channelID)
+        Nan::New(baton->channelID),
+        Nan::New(baton->cancelled)
     };
 
     Nan::AsyncResource resource("bluetooth-serial-port:SdpSearch");
-    baton->cb->Call(1, argv, &resource);
+    baton->cb->Call(2, argv, &resource);
 
     if (try_catch.HasCaught()) {
         Nan::FatalException(try_catch);
@@ -164,209 +278,2063 @@ void DeviceINQ::Init(Local<Object> target) {
     Nan::SetPrototypeMethod(t, "inquire", Inquire);
     Nan::SetPrototypeMethod(t, "findSerialPortChannel", SdpSearch);
     Nan::SetPrototypeMethod(t, "listPairedDevices", ListPairedDevices);
+    Nan::SetPrototypeMethod(t, "discover", Discover);
+    Nan::SetPrototypeMethod(t, "stopDiscovery", StopDiscovery);
+    Nan::SetPrototypeMethod(t, "cancel", Cancel);
+    Nan::SetPrototypeMethod(t, "discoverServices", DiscoverServices);
+    Nan::SetMethod(t, "parseEir", ParseEir);
+    Nan::SetMethod(t, "parseServiceRecords", ParseServiceRecords);
     target->Set(ctx, Nan::New("DeviceINQ").ToLocalChecked(), t->GetFunction(ctx).ToLocalChecked());
 }
 
-bt_inquiry DeviceINQ::doInquire() {
+// HCI status codes a controller answers with when it has no room for
+// another remote name request
+#define HCI_MEMORY_FULL 0x07
+#define HCI_COMMAND_DISALLOWED 0x0c
+
+// What inquiry_state_t.sent holds when it is not a name request
+#define COMMAND_NONE -1
+#define COMMAND_INQUIRY -2
+
+// How long the controller gets to acknowledge a command
+#define COMMAND_STATUS_TIMEOUT 2000 // ms
+
+// Extended Inquiry Response data types, Bluetooth Assigned Numbers
+#define EIR_UUID16_SOME 0x02
+#define EIR_UUID16_ALL 0x03
+#define EIR_UUID32_SOME 0x04
+#define EIR_UUID32_ALL 0x05
+#define EIR_UUID128_SOME 0x06
+#define EIR_UUID128_ALL 0x07
+#define EIR_NAME_SHORT 0x08
+#define EIR_NAME_COMPLETE 0x09
+#define EIR_TX_POWER 0x0a
+
+// Short UUIDs are offsets into the Bluetooth Base UUID
+#define EIR_BASE_UUID "-0000-1000-8000-00805f9b34fb"
+
+static void addUuid(eir_data_t *eir, const uint8_t *data, int size) {
+    if (eir->uuidCount >= EIR_MAX_UUIDS) {
+        return;
+    }
+
+    char *uuid = eir->uuids[eir->uuidCount++];
+    if (size == 2) {
+        sprintf(uuid, "0000%02x%02x" EIR_BASE_UUID, data[1], data[0]);
+    } else if (size == 4) {
+        sprintf(uuid, "%02x%02x%02x%02x" EIR_BASE_UUID, data[3], data[2], data[1], data[0]);
+    } else {
+        // 128 bit UUIDs go over the air little endian
+        sprintf(uuid, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+            data[15], data[14], data[13], data[12], data[11], data[10], data[9], data[8],
+            data[7], data[6], data[5], data[4], data[3], data[2], data[1], data[0]);
+    }
+}
+
+// Walks the length, type, value fields of an Extended Inquiry Response up
+// to the first empty field or the end of `data`. A field that runs past the
+// end is dropped. Returns whether the response held a name.
+bool DeviceINQ::parseEir(const uint8_t *data, int length, eir_data_t *eir) {
+    memset(eir, 0, sizeof(*eir));
+
+    int offset = 0;
+    while (offset < length && data[offset] != 0) {
+        int fieldLength = data[offset];
+        if (offset + 1 + fieldLength > length) {
+            break;
+        }
 
-  // do the bluetooth magic
-  inquiry_info *ii = NULL;
-  int max_rsp, num_rsp;
-  int dev_id, sock, len, flags;
-  int i;
-  char addr[19] = { 0 };
-  char name[248] = { 0 };
+        uint8_t type = data[offset + 1];
+        const uint8_t *value = data + offset + 2;
+        int size = fieldLength - 1;
+
+        switch (type) {
+            case EIR_NAME_COMPLETE:
+            case EIR_NAME_SHORT:
+                // a complete name wins over a shortened one, whichever comes first
+                if (eir->name[0] == '\0' || (type == EIR_NAME_COMPLETE && !eir->nameComplete)) {
+                    int n = std::min(size, (int) sizeof(eir->name) - 1);
+                    memcpy(eir->name, value, n);
+                    eir->name[n] = '\0';
+                    eir->nameComplete = (type == EIR_NAME_COMPLETE);
+                }
+                break;
 
-  bt_inquiry inquiryResult;
+            case EIR_TX_POWER:
+                if (size >= 1) {
+                    eir->hasTxPower = true;
+                    eir->txPower = (int8_t) value[0];
+                }
+                break;
 
-  dev_id = hci_get_route(NULL);
-  sock = hci_open_dev( dev_id );
-  if (dev_id < 0 || sock < 0) {
-    Nan::ThrowError("opening socket");
-  }
+            case EIR_UUID16_SOME:
+            case EIR_UUID16_ALL:
+                for (int i = 0; i + 2 <= size; i += 2) {
+                    addUuid(eir, value + i, 2);
+                }
+                break;
 
-  len  = 8;
-  max_rsp = 255;
-  flags = IREQ_CACHE_FLUSH;
-  ii = (inquiry_info*)malloc(max_rsp * sizeof(inquiry_info));
+            case EIR_UUID32_SOME:
+            case EIR_UUID32_ALL:
+                for (int i = 0; i + 4 <= size; i += 4) {
+                    addUuid(eir, value + i, 4);
+                }
+                break;
 
-  num_rsp = hci_inquiry(dev_id, len, max_rsp, NULL, &ii, flags);
-  // if( num_rsp < 0 ) {
-  //     return ThrowException(Exception::Error(String::New("hci inquiry")));
-  // }
-  inquiryResult.num_rsp = num_rsp;
-  inquiryResult.devices = (bt_device*)malloc(num_rsp * sizeof(bt_device));
+            case EIR_UUID128_SOME:
+            case EIR_UUID128_ALL:
+                for (int i = 0; i + 16 <= size; i += 16) {
+                    addUuid(eir, value + i, 16);
+                }
+                break;
+        }
 
-  for (i = 0; i < num_rsp; i++) {
-    ba2str(&(ii+i)->bdaddr, addr);
-    memset(name, 0, sizeof(name));
-    if (hci_read_remote_name(sock, &(ii+i)->bdaddr, sizeof(name),
-        name, 0) < 0)
-      strcpy(name, addr);
+        offset += 1 + fieldLength;
+    }
 
-    //fprintf(stderr, "%s [%s]\n", addr, name);
-    strcpy(inquiryResult.devices[i].address, addr);
-    strcpy(inquiryResult.devices[i].name, name);
-  }
+    return eir->name[0] != '\0';
+}
 
-  free( ii );
-  close( sock );
-  return inquiryResult;
+// Service class UUIDs in the same 128 bit form the EIR parser uses
+static void uuidToString(const uuid_t *uuid, char *str) {
+    if (uuid->type == SDP_UUID16) {
+        sprintf(str, "0000%04x" EIR_BASE_UUID, uuid->value.uuid16);
+    } else if (uuid->type == SDP_UUID32) {
+        sprintf(str, "%08x" EIR_BASE_UUID, uuid->value.uuid32);
+    } else {
+        // kept in network order
+        const uint8_t *data = uuid->value.uuid128.data;
+        sprintf(str, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+            data[0], data[1], data[2], data[3], data[4], data[5], data[6], data[7],
+            data[8], data[9], data[10], data[11], data[12], data[13], data[14], data[15]);
+    }
 }
 
-DeviceINQ::DeviceINQ() {
+// Reads one service record, a data element sequence of attribute id and
+// value pairs as SDP sends it and BlueZ stores it. Returns the bytes the
+// record took or -1 when `data` does not start with one.
+int DeviceINQ::parseServiceRecord(const uint8_t *data, int length, service_record_t *record) {
+    record->handle = 0;
+    record->name.clear();
+    record->uuids.clear();
+    record->channel = -1;
+    record->psm = -1;
+
+    // the library reads what it can of a record cut short, it is dropped
+    // here as a whole instead
+    uint8_t dtd;
+    int seqlen = 0;
+    int header = sdp_extract_seqtype(data, length, &dtd, &seqlen);
+    if (header <= 0 || seqlen > length - header) {
+        return -1;
+    }
 
-}
+    int scanned = 0;
+    sdp_record_t *rec = sdp_extract_pdu(data, header + seqlen, &scanned);
+    if (!rec) {
+        return -1;
+    }
+    if (scanned <= 0) {
+        sdp_record_free(rec);
+        return -1;
+    }
 
-DeviceINQ::~DeviceINQ() {
+    record->handle = rec->handle;
+
+    char name[256];
+    if (sdp_get_service_name(rec, name, sizeof(name)) == 0) {
+        record->name = name;
+    }
+
+    sdp_list_t *classes;
+    if (sdp_get_service_classes(rec, &classes) == 0) {
+        for (sdp_list_t *c = classes; c; c = c->next) {
+            char uuid[37];
+            uuidToString((const uuid_t *) c->data, uuid);
+            record->uuids.push_back(uuid);
+        }
+        sdp_list_free(classes, free);
+    }
 
+    // a port of 0 means the protocol is there without one, e.g. the L2CAP
+    // that carries RFCOMM
+    sdp_list_t *protos;
+    if (sdp_get_access_protos(rec, &protos) == 0) {
+        int channel = sdp_get_proto_port(protos, RFCOMM_UUID);
+        int psm = sdp_get_proto_port(protos, L2CAP_UUID);
+        record->channel = channel > 0 ? channel : -1;
+        record->psm = psm > 0 ? psm : -1;
+
+        for (sdp_list_t *p = protos; p; p = p->next) {
+            sdp_list_free((sdp_list_t *) p->data, 0);
+        }
+        sdp_list_free(protos, 0);
+    }
+
+    sdp_record_free(rec);
+    return header + seqlen;
 }
 
-NAN_METHOD(DeviceINQ::New) {
-    const char *usage = "usage: DeviceINQ()";
-    if (info.Length() != 0) {
-        return Nan::ThrowError(usage);
+// Reads the attribute lists of a service search attribute response, a data
+// element sequence with one record in it for each service. Returns the
+// number of records read, -1 when `data` is no sequence. Records after one
+// that cannot be read are dropped.
+int DeviceINQ::parseServiceRecords(const uint8_t *data, int length, std::vector<service_record_t> *records) {
+    records->clear();
+
+    uint8_t dtd;
+    int seqlen = 0;
+    int scanned = sdp_extract_seqtype(data, length, &dtd, &seqlen);
+    if (scanned <= 0 || seqlen > length - scanned) {
+        return -1;
+    }
+    data += scanned;
+    length = seqlen;
+
+    while (length > 0) {
+        service_record_t record;
+        int recsize = parseServiceRecord(data, length, &record);
+        if (recsize < 0) {
+            break;
+        }
+        data += recsize;
+        length -= recsize;
+        records->push_back(record);
     }
+    return records->size();
+}
 
-    DeviceINQ* inquire = new DeviceINQ();
-    inquire->Wrap(info.This());
+// Where BlueZ keeps adapters, paired devices and what it cached about them
+#define BLUEZ_STORAGE_DIR "/var/lib/bluetooth"
+
+// A paired device as BlueZ stored it
+struct paired_device_t {
+    std::string address;
+    std::string adapter;                    // the adapter it is paired with
+    std::string name;
+    int deviceClass;                        // -1 when BlueZ did not store it
+    std::vector<std::string> uuids;         // services BlueZ resolved for it
+    std::vector<service_record_t> services; // records cached from the last SDP search
+};
 
-    info.GetReturnValue().Set(info.This());
+// The groups of a key file with the keys and values in them
+typedef std::map<std::string, std::map<std::string, std::string> > key_file_t;
+
+// Reads a key file as BlueZ writes them through GLib, false when it cannot
+// be opened. Escaped characters in the values are turned back.
+static bool readKeyFile(const std::string &path, key_file_t *groups) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    std::string group;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    while ((length = getline(&line, &size, file)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        if (line[0] == '[') {
+            char *end = strchr(line, ']');
+            group = end != NULL ? std::string(line + 1, end) : std::string();
+            continue;
+        }
+
+        char *equals = strchr(line, '=');
+        if (equals == NULL) {
+            continue;
+        }
+        std::string value;
+        for (const char *c = equals + 1; *c != '\0'; c++) {
+            if (*c == '\\' && c[1] != '\0') {
+                c++;
+                value += *c == 's' ? ' ' : *c == 'n' ? '\n' : *c == 't' ? '\t' : *c == 'r' ? '\r' : *c;
+            } else {
+                value += *c;
+            }
+        }
+        (*groups)[group][std::string(line, equals)] = value;
+    }
+
+    free(line);
+    fclose(file);
+    return true;
 }
 
-NAN_METHOD(DeviceINQ::InquireSync) {
-    const char *usage = "usage: inquireSync(found, callback)";
-    if (info.Length() != 2) {
-        return Nan::ThrowError(usage);
+static const std::string *keyFileValue(const key_file_t &groups, const char *group, const char *key) {
+    key_file_t::const_iterator g = groups.find(group);
+    if (g == groups.end()) {
+        return NULL;
     }
+    std::map<std::string, std::string>::const_iterator k = g->second.find(key);
+    return k != g->second.end() ? &k->second : NULL;
+}
 
-    Nan::AsyncResource resource("bluetooth-serial-port:InquireSync");
-    Nan::Callback *found = new Nan::Callback(info[0].As<Function>());
-    Nan::Callback *callback = new Nan::Callback(info[1].As<Function>());
+// BlueZ names the directories of adapters and devices after their address
+static bool isAddressName(const char *name) {
+    return strlen(name) == 17 && bachk(name) == 0;
+}
 
-    bt_inquiry inquiryResult = DeviceINQ::doInquire();
-    for (int i = 0; i < inquiryResult.num_rsp; i++) {
-      Local<Value> argv[] = {
-        Nan::New(inquiryResult.devices[i].address).ToLocalChecked(),
-        Nan::New(inquiryResult.devices[i].name).ToLocalChecked()
-      };
-      found->Call(2, argv, &resource);
+static std::vector<std::string> addressEntries(const std::string &dir) {
+    std::vector<std::string> entries;
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL) {
+        return entries;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (isAddressName(entry->d_name)) {
+            entries.push_back(entry->d_name);
+        }
     }
+    closedir(d);
 
-    Local<Value> argv[] = {};
-    callback->Call(0, argv, &resource);
-    return;
+    // readdir has no order, the callers want a stable one
+    std::sort(entries.begin(), entries.end());
+    return entries;
 }
 
-class InquireWorker : public Nan::AsyncWorker {
- public:
-  InquireWorker(Nan::Callback* found, Nan::Callback *callback)
-    : Nan::AsyncWorker(callback), found(found) {}
-  ~InquireWorker() {}
+// Service records are stored as the hex of their PDU, under their handle
+static void readServiceRecords(const key_file_t &cache, std::vector<service_record_t> *services) {
+    key_file_t::const_iterator records = cache.find("ServiceRecords");
+    if (records == cache.end()) {
+        return;
+    }
 
-  // Executed inside the worker-thread.
-  // It is not safe to access V8, or V8 data structures
-  // here, so everything we need for input and output
-  // should go on `this`.
-  void Execute () {
-    inquiryResult = DeviceINQ::doInquire();
-  }
+    std::map<std::string, std::string>::const_iterator it;
+    for (it = records->second.begin(); it != records->second.end(); ++it) {
+        const std::string &hex = it->second;
+        std::vector<uint8_t> pdu(hex.size() / 2);
+        for (size_t i = 0; i < pdu.size(); i++) {
+            char byte[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+            pdu[i] = (uint8_t) strtoul(byte, NULL, 16);
+        }
 
-  // Executed when the async work is complete
-  // this function will be run inside the main event loop
-  // so it is safe to use V8 again
-  void HandleOKCallback () {
-    Nan::HandleScope scope;
+        service_record_t record;
+        if (!pdu.empty() && DeviceINQ::parseServiceRecord(&pdu[0], pdu.size(), &record) > 0) {
+            services->push_back(record);
+        }
+    }
+}
 
-    Nan::AsyncResource resource("bluetooth-serial-port:Inquire");
-    for (int i = 0; i < inquiryResult.num_rsp; i++) {
-      Local<Value> argv[] = {
-        Nan::New(inquiryResult.devices[i].address).ToLocalChecked(),
-        Nan::New(inquiryResult.devices[i].name).ToLocalChecked()
-      };
-      found->Call(2, argv, &resource);
+// Lists the devices with a link key or a long term key under `root`, the
+// devices that were only seen are skipped. Touches no adapter.
+static void readPairedDevices(const std::string &root, std::vector<paired_device_t> *devices) {
+    std::vector<std::string> adapters = addressEntries(root);
+    for (size_t i = 0; i < adapters.size(); i++) {
+        std::string adapterDir = root + "/" + adapters[i];
+        std::vector<std::string> addresses = addressEntries(adapterDir);
+
+        for (size_t j = 0; j < addresses.size(); j++) {
+            key_file_t info;
+            if (!readKeyFile(adapterDir + "/" + addresses[j] + "/info", &info)) {
+                continue;
+            }
+            if (info.find("LinkKey") == info.end() && info.find("LongTermKey") == info.end() &&
+                    info.find("PeripheralLongTermKey") == info.end() && info.find("SlaveLongTermKey") == info.end()) {
+                continue;
+            }
+
+            paired_device_t device;
+            device.address = addresses[j];
+            device.adapter = adapters[i];
+            device.deviceClass = -1;
+
+            key_file_t cache;
+            readKeyFile(adapterDir + "/cache/" + addresses[j], &cache);
+
+            const std::string *name = keyFileValue(info, "General", "Name");
+            if (name == NULL) {
+                name = keyFileValue(cache, "General", "Name");
+            }
+            device.name = name != NULL ? *name : device.address;
+
+            const std::string *deviceClass = keyFileValue(info, "General", "Class");
+            if (deviceClass != NULL) {
+                device.deviceClass = strtol(deviceClass->c_str(), NULL, 0);
+            }
+
+            const std::string *services = keyFileValue(info, "General", "Services");
+            if (services != NULL) {
+                size_t start = 0;
+                while (start < services->size()) {
+                    size_t end = services->find(';', start);
+                    if (end == std::string::npos) {
+                        end = services->size();
+                    }
+                    if (end > start) {
+                        device.uuids.push_back(services->substr(start, end - start));
+                    }
+                    start = end + 1;
+                }
+            }
+
+            readServiceRecords(cache, &device.services);
+            devices->push_back(device);
+        }
     }
+}
 
-    Local<Value> argv[] = {};
-    callback->Call(0, argv, &resource);
-  }
+// A device the inquiry found and what it told about itself
+struct inquiry_device_t {
+    inquiry_info info;
+    int8_t rssi;        // INQUIRY_NO_RSSI when the result carried none
+    bool hasEir;
+    eir_data_t eir;
+    bool cachedName;    // the name came from the device cache
+};
 
-  private:
-    bt_inquiry inquiryResult;
-    Nan::Callback* found;
+// A remote name request the controller accepted
+struct name_request_t {
+    int index;          // into inquiry_state_t.devices
+    uint64_t deadline;  // uv_hrtime()
 };
 
-// Asynchronous access to the `Inquire()` function
-NAN_METHOD(DeviceINQ::Inquire) {
-  const char *usage = "usage: inquire(found, callback)";
-  if (info.Length() != 2) {
-      return Nan::ThrowError(usage);
-  }
-  Nan::Callback *found = new Nan::Callback(info[0].As<Function>());
-  Nan::Callback *callback = new Nan::Callback(info[1].As<Function>());
+// The best sighting of a device among the adapters that inquire at once
+struct merged_device_t {
+    int8_t rssi;        // INQUIRY_NO_RSSI while no adapter measured one
+    char adapter[19];   // the adapter that measured it
+};
 
-  Nan::AsyncQueueWorker(new InquireWorker(found, callback));
+// What inquiries running at once on several adapters share. The adapter
+// that hears a device first claims it, only that one pages it for its name
+// and reports it. The others just bring in their RSSI. Reports go out under
+// the lock, so `found` is never called from two threads at once.
+struct inquiry_merge_t {
+    uv_mutex_t mutex;
+    std::map<std::string, merged_device_t> devices;
+};
+
+// One inquiry and the name requests that follow the devices it finds. All
+// of it is driven by the HCI events as they come in: a device is asked for
+// its name as soon as the inquiry reports it and is passed on as soon as
+// the name is in. A device that sent its name in an Extended Inquiry
+// Response is passed on right away.
+struct inquiry_state_t {
+    int sock;
+    char adapter[19];                       // address of the adapter, empty for a stand-in socket
+    inquiry_merge_t *merge;                 // NULL when no other adapter inquires alongside
+    const inquiry_options_t *options;
+    const std::function<void(const inquiry_result_t &)> *found;
+    std::vector<inquiry_device_t> devices;
+    std::deque<int> waiting;                // devices that still have to be asked for their name
+    std::vector<name_request_t> outstanding;
+    size_t limit;                           // name requests the controller takes at once
+    int sent;                               // the command waiting for its status, a device index or COMMAND_*
+    uint64_t sentDeadline;
+    bool inquiring;
+    uint64_t inquiryDeadline;
+    bool namesPaused;                       // the controller takes no name requests while it inquires
+    int inquiryStatus;                      // HCI status the inquiry failed with, 0 when it ran
+};
+
+// Every found device passes here once, so this is where it goes into the
+// device cache
+static void reportDevice(inquiry_state_t *state, int index, const char *name) {
+    inquiry_result_t result;
+    memset(&result, 0, sizeof(result));
+    const inquiry_device_t &device = state->devices[index];
+    ba2str(&device.info.bdaddr, result.device.address);
+
+    device_cache_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.seen = wallClock();
+    memcpy(entry.bdaddr, device.info.bdaddr.b, sizeof(entry.bdaddr));
+    memcpy(entry.deviceClass, device.info.dev_class, sizeof(entry.deviceClass));
+    entry.rssi = device.rssi;
+    entry.clockOffset = btohs(device.info.clock_offset);
+    entry.pscanRepMode = device.info.pscan_rep_mode;
+    // a name taken from the cache keeps the age it had
+    if (name != NULL && name[0] != '\0' && !device.cachedName) {
+        entry.named = entry.seen;
+        strncpy(entry.name, name, sizeof(entry.name) - 1);
+    }
+    BluetoothHelpers::StoreDevice(entry);
+
+    // without a name the device is reported by its address
+    strncpy(result.device.name, name != NULL && name[0] != '\0' ? name : result.device.address, sizeof(result.device.name) - 1);
+    strcpy(result.adapter, state->adapter);
+    result.rssi = device.rssi;
+    result.deviceClass = device.info.dev_class[0] | (device.info.dev_class[1] << 8) | (device.info.dev_class[2] << 16);
+    result.hasEir = device.hasEir;
+    if (device.hasEir) {
+        result.eir = device.eir;
+    }
+
+    if (state->merge == NULL) {
+        (*state->found)(result);
+        return;
+    }
+
+    // the other adapters may have heard the device better by now
+    uv_mutex_lock(&state->merge->mutex);
+    const merged_device_t &merged = state->merge->devices[result.device.address];
+    result.rssi = merged.rssi;
+    strcpy(result.adapter, merged.adapter);
+    (*state->found)(result);
+    uv_mutex_unlock(&state->merge->mutex);
 }
 
-NAN_METHOD(DeviceINQ::SdpSearch) {
-    const char *usage = "usage: findSerialPortChannel(address, callback)";
-    if (info.Length() != 2) {
-        return Nan::ThrowError(usage);
+// Claims a device for this adapter, false when another adapter already did.
+// Either way the stronger RSSI wins.
+static bool claimDevice(inquiry_state_t *state, const bdaddr_t *bdaddr, int8_t rssi) {
+    char address[19];
+    ba2str(bdaddr, address);
+
+    uv_mutex_lock(&state->merge->mutex);
+    std::map<std::string, merged_device_t>::iterator it = state->merge->devices.find(address);
+    bool claimed = (it == state->merge->devices.end());
+    if (claimed) {
+        merged_device_t merged;
+        merged.rssi = rssi;
+        strcpy(merged.adapter, state->adapter);
+        state->merge->devices[address] = merged;
+    } else if (rssi != INQUIRY_NO_RSSI && (it->second.rssi == INQUIRY_NO_RSSI || rssi > it->second.rssi)) {
+        it->second.rssi = rssi;
+        strcpy(it->second.adapter, state->adapter);
     }
+    uv_mutex_unlock(&state->merge->mutex);
+    return claimed;
+}
 
-    if (!info[0]->IsString()) {
-        return Nan::ThrowTypeError("First argument should be a string value");
+// Inquiry results repeat devices that answer more than once
+static void addDevice(inquiry_state_t *state, const inquiry_info *info, int8_t rssi, const uint8_t *eir) {
+    for (size_t i = 0; i < state->devices.size(); i++) {
+        if (bacmp(&state->devices[i].info.bdaddr, &info->bdaddr) == 0) {
+            return;
+        }
+    }
+    if (state->merge != NULL && !claimDevice(state, &info->bdaddr, rssi)) {
+        return;
     }
-    String::Utf8Value address(info.GetIsolate(), info[0]);
 
-    if(!info[1]->IsFunction()) {
-        return Nan::ThrowTypeError("Second argument must be a function");
+    inquiry_device_t device;
+    device.info = *info;
+    device.rssi = rssi;
+    device.hasEir = (eir != NULL);
+    device.cachedName = false;
+    bool named = device.hasEir && DeviceINQ::parseEir(eir, HCI_MAX_EIR_LENGTH, &device.eir);
+
+    // a name read recently enough is taken over without paging the device
+    device_cache_entry_t cached;
+    if (!named && state->options->cacheTtl > 0 && BluetoothHelpers::LookupDevice(info->bdaddr.b, &cached) &&
+            cached.named != 0 && wallClock() - cached.named <= (uint64_t) state->options->cacheTtl) {
+        device.cachedName = true;
+    }
+    state->devices.push_back(device);
+
+    // a name from the response, even a shortened one, saves paging the device
+    if (named) {
+        reportDevice(state, state->devices.size() - 1, device.eir.name);
+    } else if (device.cachedName) {
+        reportDevice(state, state->devices.size() - 1, cached.name);
+    } else {
+        state->waiting.push_back(state->devices.size() - 1);
     }
+}
 
-    Local<Function> cb = info[1].As<Function>();
+static void handleEvent(inquiry_state_t *state, const unsigned char *buf, ssize_t len, uint64_t now) {
+    if (len < 1 + HCI_EVENT_HDR_SIZE || buf[0] != HCI_EVENT_PKT) {
+        return;
+    }
 
-    DeviceINQ* inquire = Nan::ObjectWrap::Unwrap<DeviceINQ>(info.This());
+    const hci_event_hdr *hdr = (const hci_event_hdr *) (buf + 1);
+    const unsigned char *ptr = buf + 1 + HCI_EVENT_HDR_SIZE;
+    int plen = std::min((int) hdr->plen, (int) (len - (1 + HCI_EVENT_HDR_SIZE)));
+    const uint16_t inquiryOpcode = htobs(cmd_opcode_pack(OGF_LINK_CTL, OCF_INQUIRY));
+    const uint16_t nameOpcode = htobs(cmd_opcode_pack(OGF_LINK_CTL, OCF_REMOTE_NAME_REQ));
 
-    sdp_baton_t *baton = new sdp_baton_t();
-    baton->inquire = inquire;
-    baton->cb = new Nan::Callback(cb);
-    strcpy(baton->address, *address);
-    baton->channelID = -1;
-    baton->request.data = baton;
-    baton->inquire->Ref();
+    switch (hdr->evt) {
+        case EVT_CMD_STATUS: {
+            if (plen < EVT_CMD_STATUS_SIZE) {
+                return;
+            }
+            const evt_cmd_status *cs = (const evt_cmd_status *) ptr;
 
-    uv_queue_work(uv_default_loop(), &baton->request, EIO_SdpSearch, (uv_after_work_cb)EIO_AfterSdpSearch);
+            if (cs->opcode == inquiryOpcode && state->sent == COMMAND_INQUIRY) {
+                if (cs->status != 0) {
+                    state->inquiryStatus = cs->status;
+                    state->inquiring = false;
+                }
+                state->sent = COMMAND_NONE;
+            } else if (cs->opcode == nameOpcode && state->sent >= 0) {
+                if (cs->status == 0) {
+                    name_request_t request = { state->sent, now + (uint64_t) state->options->nameTimeout * 1000000 };
+                    state->outstanding.push_back(request);
+                } else if (cs->status == HCI_COMMAND_DISALLOWED && state->inquiring) {
+                    // ask again once the inquiry is done
+                    state->namesPaused = true;
+                    state->waiting.push_front(state->sent);
+                } else if (!state->outstanding.empty() && (cs->status == HCI_COMMAND_DISALLOWED || cs->status == HCI_MEMORY_FULL)) {
+                    // the controller takes fewer requests at once, ask again when one is done
+                    state->limit = state->outstanding.size();
+                    state->waiting.push_front(state->sent);
+                } else {
+                    reportDevice(state, state->sent, NULL);
+                }
+                state->sent = COMMAND_NONE;
+            }
+            return;
+        }
 
-    return;
-}
+        case EVT_INQUIRY_RESULT: {
+            int count = plen > 0 ? ptr[0] : 0;
+            for (int i = 0; i < count && 1 + (i + 1) * INQUIRY_INFO_SIZE <= plen; i++) {
+                inquiry_info device;
+                memcpy(&device, ptr + 1 + i * INQUIRY_INFO_SIZE, INQUIRY_INFO_SIZE);
+                addDevice(state, &device, INQUIRY_NO_RSSI, NULL);
+            }
+            return;
+        }
 
-NAN_METHOD(DeviceINQ::ListPairedDevices) {
-    const char *usage = "usage: listPairedDevices(callback)";
-    if (info.Length() != 1) {
-        return Nan::ThrowError(usage);
+        case EVT_INQUIRY_RESULT_WITH_RSSI: {
+            int count = plen > 0 ? ptr[0] : 0;
+            for (int i = 0; i < count && 1 + (i + 1) * INQUIRY_INFO_WITH_RSSI_SIZE <= plen; i++) {
+                const inquiry_info_with_rssi *result = (const inquiry_info_with_rssi *) (ptr + 1 + i * INQUIRY_INFO_WITH_RSSI_SIZE);
+                inquiry_info device;
+                memset(&device, 0, sizeof(device));
+                bacpy(&device.bdaddr, &result->bdaddr);
+                device.pscan_rep_mode = result->pscan_rep_mode;
+                device.pscan_period_mode = result->pscan_period_mode;
+                memcpy(device.dev_class, result->dev_class, sizeof(device.dev_class));
+                device.clock_offset = result->clock_offset;
+                addDevice(state, &device, result->rssi, NULL);
+            }
+            return;
+        }
+
+        case EVT_EXTENDED_INQUIRY_RESULT: {
+            int count = plen > 0 ? ptr[0] : 0;
+            for (int i = 0; i < count && 1 + (i + 1) * EXTENDED_INQUIRY_INFO_SIZE <= plen; i++) {
+                const extended_inquiry_info *result = (const extended_inquiry_info *) (ptr + 1 + i * EXTENDED_INQUIRY_INFO_SIZE);
+                inquiry_info device;
+                memset(&device, 0, sizeof(device));
+                bacpy(&device.bdaddr, &result->bdaddr);
+                device.pscan_rep_mode = result->pscan_rep_mode;
+                device.pscan_period_mode = result->pscan_period_mode;
+                memcpy(device.dev_class, result->dev_class, sizeof(device.dev_class));
+                device.clock_offset = result->clock_offset;
+                addDevice(state, &device, result->rssi, result->data);
+            }
+            return;
+        }
+
+        case EVT_INQUIRY_COMPLETE:
+            state->inquiring = false;
+            state->namesPaused = false;
+            return;
+
+        case EVT_REMOTE_NAME_REQ_COMPLETE: {
+            if (plen < 7) {
+                return;
+            }
+            const evt_remote_name_req_complete *rn = (const evt_remote_name_req_complete *) ptr;
+            for (size_t j = 0; j < state->outstanding.size(); j++) {
+                int index = state->outstanding[j].index;
+                if (bacmp(&rn->bdaddr, &state->devices[index].info.bdaddr) != 0) {
+                    continue;
+                }
+
+                char name[HCI_MAX_NAME_LENGTH + 1] = { 0 };
+                if (rn->status == 0) {
+                    memcpy(name, rn->name, std::min(plen - 7, HCI_MAX_NAME_LENGTH));
+                }
+                state->outstanding.erase(state->outstanding.begin() + j);
+                reportDevice(state, index, name);
+                return;
+            }
+            return;
+        }
     }
+}
 
-    if(!info[0]->IsFunction()) {
-       return Nan::ThrowTypeError("First argument must be a function");
+// Runs an inquiry on `sock` and reads the names of the devices it finds
+// with up to options.nameConcurrency remote name requests outstanding.
+// Commands go out one at a time, each waits for its command status, but
+// the slow parts, inquiring and paging the devices, overlap. A device that
+// does not give its name within options.nameTimeout is reported by its
+// address. CONTROL_CLOSE on `control` cancels the inquiry and the name
+// requests, the devices not reported by then are dropped and -1 is
+// returned with errno ECANCELED. With `known` no inquiry is run, the names
+// of those devices are read. `devId` is the adapter behind `sock`, -1 for
+// a stand-in, and `merge` what it shares with other adapters, if any.
+static int runInquiry(int sock, int devId, inquiry_merge_t *merge, const inquiry_options_t &options, control_channel_t *control, const std::vector<inquiry_info> *known,
+        const std::function<void(const inquiry_result_t &)> &found) {
+    struct hci_filter saved, filter;
+    socklen_t savedLen = sizeof(saved);
+    bool restore = getsockopt(sock, SOL_HCI, HCI_FILTER, &saved, &savedLen) == 0;
+
+    // only a real HCI socket filters, events for others are skipped below
+    hci_filter_clear(&filter);
+    hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
+    hci_filter_set_event(EVT_CMD_STATUS, &filter);
+    hci_filter_set_event(EVT_INQUIRY_RESULT, &filter);
+    hci_filter_set_event(EVT_INQUIRY_RESULT_WITH_RSSI, &filter);
+    hci_filter_set_event(EVT_EXTENDED_INQUIRY_RESULT, &filter);
+    hci_filter_set_event(EVT_INQUIRY_COMPLETE, &filter);
+    hci_filter_set_event(EVT_REMOTE_NAME_REQ_COMPLETE, &filter);
+    setsockopt(sock, SOL_HCI, HCI_FILTER, &filter, sizeof(filter));
+
+    inquiry_state_t state;
+    state.sock = sock;
+    state.adapter[0] = '\0';
+    if (devId >= 0) {
+        bdaddr_t bdaddr;
+        if (hci_devba(devId, &bdaddr) == 0) {
+            ba2str(&bdaddr, state.adapter);
+        }
+    }
+    state.merge = merge;
+    state.options = &options;
+    state.found = &found;
+    state.limit = options.nameConcurrency > 0 ? options.nameConcurrency : 1;
+    state.inquiring = (known == NULL);
+    state.namesPaused = false;
+    state.inquiryStatus = 0;
+    state.sent = COMMAND_NONE;
+
+    uint64_t now = uv_hrtime();
+    if (known != NULL) {
+        for (size_t i = 0; i < known->size(); i++) {
+            addDevice(&state, &(*known)[i], INQUIRY_NO_RSSI, NULL);
+        }
+    } else {
+        inquiry_cp cp;
+        cp.lap[0] = options.lap & 0xff;
+        cp.lap[1] = (options.lap >> 8) & 0xff;
+        cp.lap[2] = (options.lap >> 16) & 0xff;
+        cp.length = options.length;
+        cp.num_rsp = options.maxResponses;
+
+        if (hci_send_cmd(sock, OGF_LINK_CTL, OCF_INQUIRY, INQUIRY_CP_SIZE, &cp) < 0) {
+            if (restore) {
+                setsockopt(sock, SOL_HCI, HCI_FILTER, &saved, sizeof(saved));
+            }
+            return -1;
+        }
+        state.sent = COMMAND_INQUIRY;
+        state.sentDeadline = now + (uint64_t) COMMAND_STATUS_TIMEOUT * 1000000;
+        // the controller ends the inquiry itself, this only guards against a lost event
+        state.inquiryDeadline = now + ((uint64_t) options.length * 1280 + COMMAND_STATUS_TIMEOUT) * 1000000;
     }
-    Local<Function> cb = info[0].As<Function>();
 
-    Local<Array> resultArray = Local<Array>(Nan::New<Array>());
+    bool failed = false;
+    bool cancelled = false;
+    while (!failed && !cancelled && (state.inquiring || state.sent != COMMAND_NONE || !state.waiting.empty() || !state.outstanding.empty())) {
+        now = uv_hrtime();
+
+        if (state.sent == COMMAND_NONE && !state.waiting.empty() && !state.namesPaused && state.outstanding.size() < state.limit) {
+            int i = state.waiting.front();
+            state.waiting.pop_front();
+
+            remote_name_req_cp nameCp;
+            memset(&nameCp, 0, sizeof(nameCp));
+            bacpy(&nameCp.bdaddr, &state.devices[i].info.bdaddr);
+            nameCp.pscan_rep_mode = state.devices[i].info.pscan_rep_mode;
+            nameCp.pscan_mode = state.devices[i].info.pscan_mode;
+            // the offset from the inquiry spares the controller a full page scan
+            nameCp.clock_offset = state.devices[i].info.clock_offset | htobs(0x8000);
+
+            if (hci_send_cmd(sock, OGF_LINK_CTL, OCF_REMOTE_NAME_REQ, REMOTE_NAME_REQ_CP_SIZE, &nameCp) < 0) {
+                reportDevice(&state, i, NULL);
+                continue;
+            }
+            state.sent = i;
+            state.sentDeadline = now + (uint64_t) options.nameTimeout * 1000000;
+        }
 
-    // TODO: build an array of objects representing a paired device:
-    // ex: {
-    //   name: 'MyBluetoothDeviceName',
-    //   address: '12-34-56-78-90',
-    //   services: [
-    //     { name: 'SPP', channel: 1 },
-    //     { name: 'iAP', channel: 2 }
-    //   ]
-    // }
+        // give up on whatever ran out of time
+        uint64_t next = UINT64_MAX;
+        if (state.inquiring) {
+            if (state.inquiryDeadline <= now) {
+                state.inquiring = false;
+                state.namesPaused = false;
+            } else {
+                next = state.inquiryDeadline;
+            }
+        }
+        if (state.sent != COMMAND_NONE) {
+            if (state.sentDeadline > now) {
+                next = std::min(next, state.sentDeadline);
+            } else if (state.sent == COMMAND_INQUIRY) {
+                state.inquiring = false;
+                state.sent = COMMAND_NONE;
+                state.inquiryStatus = -1;
+            } else {
+                reportDevice(&state, state.sent, NULL);
+                state.sent = COMMAND_NONE;
+            }
+        }
+        for (size_t j = 0; j < state.outstanding.size();) {
+            if (state.outstanding[j].deadline <= now) {
+                int index = state.outstanding[j].index;
+                remote_name_req_cancel_cp cancel;
+                bacpy(&cancel.bdaddr, &state.devices[index].info.bdaddr);
+                hci_send_cmd(sock, OGF_LINK_CTL, OCF_REMOTE_NAME_REQ_CANCEL, REMOTE_NAME_REQ_CANCEL_CP_SIZE, &cancel);
+                state.outstanding.erase(state.outstanding.begin() + j);
+                reportDevice(&state, index, NULL);
+                continue;
+            }
+            next = std::min(next, state.outstanding[j].deadline);
+            j++;
+        }
+        if (next == UINT64_MAX) {
+            continue;
+        }
 
-    Local<Value> argv[1] = {
+        struct pollfd p[2];
+        p[0].fd = sock;
+        p[0].events = POLLIN;
+        p[0].revents = 0;
+        p[1].fd = control != NULL ? control->fd : -1;
+        p[1].events = POLLIN;
+        p[1].revents = 0;
+        int ready = poll(p, 2, (int) ((next - now) / 1000000) + 1);
+        if (ready <= 0) {
+            failed = (ready < 0 && errno != EINTR);
+            continue;
+        }
+
+        if ((p[1].revents & POLLIN) && (BluetoothHelpers::TakeControl(control) & CONTROL_CLOSE)) {
+            cancelled = true;
+            continue;
+        }
+        if (p[0].revents == 0) {
+            continue;
+        }
+
+        unsigned char buf[HCI_MAX_EVENT_SIZE];
+        ssize_t len = read(sock, buf, sizeof(buf));
+        if (len <= 0) {
+            // a closed stand-in socket reads 0, there is nothing more to come
+            failed = (len == 0 || (errno != EAGAIN && errno != EINTR));
+            continue;
+        }
+
+        handleEvent(&state, buf, len, uv_hrtime());
+    }
+
+    if (cancelled) {
+        // the controller gets to stop early, answers that still come in
+        // are dropped along with the socket filter
+        if (state.inquiring) {
+            hci_send_cmd(sock, OGF_LINK_CTL, OCF_INQUIRY_CANCEL, 0, NULL);
+        }
+        for (size_t j = 0; j < state.outstanding.size(); j++) {
+            remote_name_req_cancel_cp cancel;
+            bacpy(&cancel.bdaddr, &state.devices[state.outstanding[j].index].info.bdaddr);
+            hci_send_cmd(sock, OGF_LINK_CTL, OCF_REMOTE_NAME_REQ_CANCEL, REMOTE_NAME_REQ_CANCEL_CP_SIZE, &cancel);
+        }
+    } else {
+        // the socket broke down, whatever is left goes out without a name
+        if (state.sent >= 0) {
+            reportDevice(&state, state.sent, NULL);
+        }
+        for (size_t j = 0; j < state.outstanding.size(); j++) {
+            reportDevice(&state, state.outstanding[j].index, NULL);
+        }
+        for (size_t j = 0; j < state.waiting.size(); j++) {
+            reportDevice(&state, state.waiting[j], NULL);
+        }
+    }
+
+    if (restore) {
+        setsockopt(sock, SOL_HCI, HCI_FILTER, &saved, sizeof(saved));
+    }
+
+    if (cancelled) {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    if (state.inquiryStatus != 0 && state.devices.empty()) {
+        errno = EIO;
+        return -1;
+    }
+    return state.devices.size();
+}
+
+static void initInquiryOptions(inquiry_options_t *options) {
+  options->nameConcurrency = NAME_DEFAULT_CONCURRENCY;
+  options->nameTimeout = NAME_DEFAULT_TIMEOUT;
+  options->hciSocket = -1;
+  options->length = INQUIRY_DEFAULT_LENGTH;
+  options->maxResponses = 0;
+  options->lap = INQUIRY_GIAC;
+  options->flushCache = true;
+  options->cacheTtl = 0;
+  options->cacheFile.clear();
+  options->adapters.clear();
+  options->allAdapters = false;
+}
+
+// The socket an inquiry runs over, -1 with errno set when the adapter
+// cannot be opened. `adapter` is the HCI device id to open, -1 for the
+// default one. `devId` is the adapter opened, -1 for a stand-in socket.
+static int openInquirySocket(const inquiry_options_t &options, int adapter, int *devId) {
+  *devId = -1;
+  // a stand-in socket belongs to the caller
+  if (options.hciSocket >= 0) {
+    return options.hciSocket;
+  }
+
+  int dev_id = adapter >= 0 ? adapter : hci_get_route(NULL);
+  int sock = hci_open_dev( dev_id );
+  if (dev_id < 0 || sock < 0) {
+    return -1;
+  }
+
+  // in extended inquiry mode devices send their name along, controllers
+  // that predate it fail the read and stay as they are
+  uint8_t mode;
+  if (hci_read_inquiry_mode(sock, &mode, 1000) == 0 && mode != 2) {
+    hci_write_inquiry_mode(sock, 2, 1000);
+  }
+  *devId = dev_id;
+  return sock;
+}
+
+static void closeInquirySocket(const inquiry_options_t &options, int sock) {
+  if (sock != options.hciSocket) {
+    int err = errno;
+    close( sock );
+    errno = err;
+  }
+}
+
+// The inquiry on one adapter, -1 for the default one
+static int inquireAdapter(const inquiry_options_t &options, int adapter, inquiry_merge_t *merge,
+    control_channel_t *control, const std::function<void(const inquiry_result_t &)> &found) {
+  int devId;
+  int sock = openInquirySocket(options, adapter, &devId);
+  if (sock < 0) {
+    return -1;
+  }
+
+  int num_rsp;
+  if (!options.flushCache && devId >= 0) {
+    // the kernel answers from the results of an inquiry in the last half
+    // minute or so, otherwise it runs one and answers when it is done. It
+    // cannot be cancelled, a cancel meanwhile stops the names that follow.
+    uint8_t lap[3] = { (uint8_t) (options.lap & 0xff), (uint8_t) ((options.lap >> 8) & 0xff), (uint8_t) ((options.lap >> 16) & 0xff) };
+    std::vector<inquiry_info> known(255);
+    inquiry_info *ii = &known[0];
+    int count = hci_inquiry(devId, options.length, options.maxResponses, lap, &ii, 0);
+    if (count < 0) {
+      closeInquirySocket(options, sock);
+      return -1;
+    }
+    known.resize(count);
+    num_rsp = runInquiry(sock, devId, merge, options, control, &known, found);
+  } else {
+    num_rsp = runInquiry(sock, devId, merge, options, control, NULL, found);
+  }
+  closeInquirySocket(options, sock);
+  return num_rsp;
+}
+
+// One adapter of an inquiry over several, run on a thread of its own
+struct adapter_inquiry_t {
+  const inquiry_options_t *options;
+  const std::function<void(const inquiry_result_t &)> *found;
+  inquiry_merge_t *merge;
+  int devId;
+  control_channel_t control;      // cancels this adapter's inquiry
+  control_channel_t *finished;    // signalled when it is done
+  std::atomic<bool> done;
+  int result;
+  int error;                      // errno when result is -1
+  uv_thread_t thread;
+};
+
+static void runAdapterInquiry(void *arg) {
+  adapter_inquiry_t *job = static_cast<adapter_inquiry_t *>(arg);
+  job->result = inquireAdapter(*job->options, job->devId, job->merge, &job->control, *job->found);
+  job->error = errno;
+  job->done = true;
+  BluetoothHelpers::SignalControl(job->finished, CONTROL_CLOSE);
+}
+
+// Inquires on all `adapters` at once, every one over its own HCI socket on
+// its own thread. Each device is reported once, with the best RSSI any of
+// the adapters measured by then. A cancel on `control` is passed on to
+// every adapter. Returns the devices found, or -1 when every adapter failed.
+static int inquireAdapters(const inquiry_options_t &options, const std::vector<int> &adapters,
+    control_channel_t *control, const std::function<void(const inquiry_result_t &)> &found) {
+  control_channel_t finished;
+  if (BluetoothHelpers::OpenControl(&finished) < 0) {
+    return -1;
+  }
+
+  inquiry_merge_t merge;
+  uv_mutex_init(&merge.mutex);
+
+  std::vector<adapter_inquiry_t> jobs(adapters.size());
+  for (size_t i = 0; i < jobs.size(); i++) {
+    adapter_inquiry_t &job = jobs[i];
+    job.options = &options;
+    job.found = &found;
+    job.merge = &merge;
+    job.devId = adapters[i];
+    job.finished = &finished;
+    job.done = true;
+    job.result = -1;
+    job.error = 0;
+    if (BluetoothHelpers::OpenControl(&job.control) < 0) {
+      job.error = errno;
+      continue;
+    }
+    job.done = false;
+    if (uv_thread_create(&job.thread, runAdapterInquiry, &job) != 0) {
+      job.error = EAGAIN;
+      job.done = true;
+      BluetoothHelpers::CloseControl(&job.control);
+    }
+  }
+
+  bool cancelled = false;
+  for (;;) {
+    size_t running = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+      running += jobs[i].done ? 0 : 1;
+    }
+    if (running == 0) {
+      break;
+    }
+
+    struct pollfd p[2];
+    p[0].fd = finished.fd;
+    p[0].events = POLLIN;
+    p[0].revents = 0;
+    p[1].fd = control != NULL && !cancelled ? control->fd : -1;
+    p[1].events = POLLIN;
+    p[1].revents = 0;
+    if (poll(p, 2, -1) < 0) {
+      continue;
+    }
+
+    if (p[0].revents & POLLIN) {
+      BluetoothHelpers::TakeControl(&finished);
+    }
+    if ((p[1].revents & POLLIN) && (BluetoothHelpers::TakeControl(control) & CONTROL_CLOSE)) {
+      cancelled = true;
+      for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i].control.fd >= 0) {
+          BluetoothHelpers::SignalControl(&jobs[i].control, CONTROL_CLOSE);
+        }
+      }
+    }
+  }
+
+  int error = EIO;
+  bool failed = true;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    if (jobs[i].control.fd >= 0) {
+      uv_thread_join(&jobs[i].thread);
+      BluetoothHelpers::CloseControl(&jobs[i].control);
+    }
+    if (jobs[i].result >= 0) {
+      failed = false;
+    } else if (jobs[i].error != 0) {
+      error = jobs[i].error;
+    }
+  }
+  int count = merge.devices.size();
+
+  uv_mutex_destroy(&merge.mutex);
+  BluetoothHelpers::CloseControl(&finished);
+
+  if (cancelled) {
+    errno = ECANCELED;
+    return -1;
+  }
+  if (failed) {
+    errno = error;
+    return -1;
+  }
+  return count;
+}
+
+int DeviceINQ::doInquire(const inquiry_options_t &options, const std::function<void(const inquiry_result_t &)> &found,
+    control_channel_t *control) {
+  // the file is read on every inquiry to pick up what other processes
+  // found, a file that cannot be read leaves the cache as it is
+  if (!options.cacheFile.empty()) {
+    BluetoothHelpers::LoadDeviceCache(options.cacheFile);
+  }
+
+  std::vector<int> adapters = options.adapters;
+  if (options.allAdapters) {
+    std::vector<adapter_stats_t> up;
+    if (BluetoothHelpers::GetAdapterStats(up) < 0) {
+      return -1;
+    }
+    if (up.empty()) {
+      errno = ENODEV;
+      return -1;
+    }
+    adapters.clear();
+    for (size_t i = 0; i < up.size(); i++) {
+      adapters.push_back(up[i].devId);
+    }
+  }
+
+  int num_rsp;
+  if (adapters.size() > 1 && options.hciSocket < 0) {
+    num_rsp = inquireAdapters(options, adapters, control, found);
+  } else {
+    num_rsp = inquireAdapter(options, adapters.empty() ? -1 : adapters[0], NULL, control, found);
+  }
+
+  if (num_rsp >= 0 && !options.cacheFile.empty()) {
+    BluetoothHelpers::SaveDeviceCache(options.cacheFile);
+  }
+  return num_rsp;
+}
+
+DeviceINQ::DeviceINQ() : discovery(NULL), nextOperation(1) {
+
+}
+
+// Makes an operation cancellable from JS, returns the id to cancel it by
+int DeviceINQ::StartOperation(control_channel_t *control) {
+  int id = nextOperation++;
+  operations[id] = control;
+  return id;
+}
+
+void DeviceINQ::EndOperation(int id) {
+  operations.erase(id);
+}
+
+DeviceINQ::~DeviceINQ() {
+
+}
+
+NAN_METHOD(DeviceINQ::New) {
+    const char *usage = "usage: DeviceINQ()";
+    if (info.Length() != 0) {
+        return Nan::ThrowError(usage);
+    }
+
+    DeviceINQ* inquire = new DeviceINQ();
+    inquire->Wrap(info.This());
+
+    info.GetReturnValue().Set(info.This());
+}
+
+// The Extended Inquiry Response of a device as handed to JS
+static Local<Object> eirToObject(const eir_data_t &eir) {
+  Local<Object> result = Nan::New<Object>();
+  if (eir.name[0] != '\0') {
+    Nan::Set(result, Nan::New("name").ToLocalChecked(), Nan::New(eir.name).ToLocalChecked());
+    Nan::Set(result, Nan::New("nameComplete").ToLocalChecked(), Nan::New(eir.nameComplete));
+  }
+  if (eir.hasTxPower) {
+    Nan::Set(result, Nan::New("txPower").ToLocalChecked(), Nan::New(eir.txPower));
+  }
+
+  Local<Array> uuids = Nan::New<Array>(eir.uuidCount);
+  for (int i = 0; i < eir.uuidCount; i++) {
+    Nan::Set(uuids, i, Nan::New(eir.uuids[i]).ToLocalChecked());
+  }
+  Nan::Set(result, Nan::New("uuids").ToLocalChecked(), uuids);
+
+  return result;
+}
+
+// A service record as handed to JS, the name like the other platforms hand
+// it and the ports only when the record has them
+static Local<Object> serviceToObject(const service_record_t &record) {
+  Local<Object> service = Nan::New<Object>();
+  Nan::Set(service, Nan::New("handle").ToLocalChecked(), Nan::New(record.handle));
+  if (!record.name.empty()) {
+    Nan::Set(service, Nan::New("name").ToLocalChecked(), Nan::New(record.name).ToLocalChecked());
+  } else {
+    Nan::Set(service, Nan::New("name").ToLocalChecked(), Nan::Undefined());
+  }
+  if (record.channel >= 0) {
+    Nan::Set(service, Nan::New("channel").ToLocalChecked(), Nan::New(record.channel));
+  }
+  if (record.psm >= 0) {
+    Nan::Set(service, Nan::New("psm").ToLocalChecked(), Nan::New(record.psm));
+  }
+
+  Local<Array> uuids = Nan::New<Array>((int) record.uuids.size());
+  for (size_t i = 0; i < record.uuids.size(); i++) {
+    Nan::Set(uuids, i, Nan::New(record.uuids[i]).ToLocalChecked());
+  }
+  Nan::Set(service, Nan::New("uuids").ToLocalChecked(), uuids);
+
+  return service;
+}
+
+// A found device as handed to JS by a continuous discovery and along
+// with every device an inquiry finds
+static Local<Object> resultToObject(const inquiry_result_t &result) {
+  Local<Object> device = Nan::New<Object>();
+  Nan::Set(device, Nan::New("address").ToLocalChecked(), Nan::New(result.device.address).ToLocalChecked());
+  Nan::Set(device, Nan::New("name").ToLocalChecked(), Nan::New(result.device.name).ToLocalChecked());
+  if (result.rssi != INQUIRY_NO_RSSI) {
+    Nan::Set(device, Nan::New("rssi").ToLocalChecked(), Nan::New(result.rssi));
+  }
+  Nan::Set(device, Nan::New("deviceClass").ToLocalChecked(), Nan::New(result.deviceClass));
+  if (result.adapter[0] != '\0') {
+    Nan::Set(device, Nan::New("adapter").ToLocalChecked(), Nan::New(result.adapter).ToLocalChecked());
+  }
+  if (result.hasEir) {
+    Nan::Set(device, Nan::New("eir").ToLocalChecked(), eirToObject(result.eir));
+  }
+  return device;
+}
+
+// Options shared by inquire() and discover(), NULL when they are fine,
+// otherwise what is wrong with them
+static const char *parseInquiryOptions(Local<Object> jsOptions, inquiry_options_t *options) {
+  Isolate *isolate = jsOptions->GetIsolate();
+  Local<Context> ctx = Nan::GetCurrentContext();
+  Local<Value> concurrency = Nan::Get(jsOptions, Nan::New("nameConcurrency").ToLocalChecked()).ToLocalChecked();
+  Local<Value> timeout = Nan::Get(jsOptions, Nan::New("nameTimeout").ToLocalChecked()).ToLocalChecked();
+  Local<Value> hciSocket = Nan::Get(jsOptions, Nan::New("hciSocket").ToLocalChecked()).ToLocalChecked();
+  Local<Value> cacheTtl = Nan::Get(jsOptions, Nan::New("cacheTtl").ToLocalChecked()).ToLocalChecked();
+  Local<Value> cacheFile = Nan::Get(jsOptions, Nan::New("cacheFile").ToLocalChecked()).ToLocalChecked();
+  Local<Value> length = Nan::Get(jsOptions, Nan::New("length").ToLocalChecked()).ToLocalChecked();
+  Local<Value> maxResponses = Nan::Get(jsOptions, Nan::New("maxResponses").ToLocalChecked()).ToLocalChecked();
+  Local<Value> lap = Nan::Get(jsOptions, Nan::New("lap").ToLocalChecked()).ToLocalChecked();
+  Local<Value> flushCache = Nan::Get(jsOptions, Nan::New("flushCache").ToLocalChecked()).ToLocalChecked();
+  Local<Value> adapters = Nan::Get(jsOptions, Nan::New("adapters").ToLocalChecked()).ToLocalChecked();
+
+  if (!concurrency->IsUndefined()) {
+    options->nameConcurrency = concurrency->Int32Value(ctx).FromMaybe(0);
+    if (options->nameConcurrency <= 0) {
+      return "Option nameConcurrency should be a positive int value.";
+    }
+  }
+  if (!timeout->IsUndefined()) {
+    options->nameTimeout = timeout->Int32Value(ctx).FromMaybe(0);
+    if (options->nameTimeout <= 0) {
+      return "Option nameTimeout should be a positive int value.";
+    }
+  }
+  if (!hciSocket->IsUndefined()) {
+    options->hciSocket = hciSocket->Int32Value(ctx).FromMaybe(-1);
+    if (options->hciSocket < 0) {
+      return "Option hciSocket should be a file descriptor.";
+    }
+  }
+  if (!cacheTtl->IsUndefined()) {
+    options->cacheTtl = cacheTtl->Int32Value(ctx).FromMaybe(-1);
+    if (options->cacheTtl < 0) {
+      return "Option cacheTtl should be a positive int value.";
+    }
+  }
+  if (!cacheFile->IsUndefined()) {
+    if (!cacheFile->IsString()) {
+      return "Option cacheFile should be a string value.";
+    }
+    String::Utf8Value path(isolate, cacheFile);
+    options->cacheFile = *path;
+  }
+  if (!length->IsUndefined()) {
+    options->length = length->Int32Value(ctx).FromMaybe(0);
+    if (options->length < 1 || options->length > INQUIRY_MAX_LENGTH) {
+      return "Option length should be an int value from 1 to 48.";
+    }
+  }
+  if (!maxResponses->IsUndefined()) {
+    options->maxResponses = maxResponses->Int32Value(ctx).FromMaybe(-1);
+    if (options->maxResponses < 0 || options->maxResponses > 255) {
+      return "Option maxResponses should be an int value from 0 to 255.";
+    }
+  }
+  if (!lap->IsUndefined()) {
+    // the dedicated access codes lie between the two
+    if (lap->IsString()) {
+      String::Utf8Value name(isolate, lap);
+      options->lap = strcmp(*name, "giac") == 0 ? INQUIRY_GIAC : strcmp(*name, "liac") == 0 ? INQUIRY_LIAC : -1;
+    } else {
+      options->lap = lap->Int32Value(ctx).FromMaybe(-1);
+    }
+    if (options->lap < INQUIRY_LIAC || options->lap > INQUIRY_GIAC) {
+      return "Option lap should be 'giac', 'liac' or an access code from 0x9e8b00 to 0x9e8b3f.";
+    }
+  }
+  if (!flushCache->IsUndefined()) {
+    options->flushCache = flushCache->BooleanValue(isolate);
+  }
+  if (!adapters->IsUndefined()) {
+    const char *error = "Option adapters should be 'all' or a list of names (hci0), indexes or addresses of available adapters.";
+    options->adapters.clear();
+    if (adapters->IsString()) {
+      if (strcmp(*String::Utf8Value(isolate, adapters), "all") != 0) {
+        return error;
+      }
+      options->allAdapters = true;
+    } else if (adapters->IsArray()) {
+      Local<Array> list = adapters.As<Array>();
+      for (uint32_t i = 0; i < list->Length(); i++) {
+        int devId;
+        Local<Value> adapter = Nan::Get(list, i).ToLocalChecked();
+        if (!BluetoothHelpers::ParseAdapter(*String::Utf8Value(isolate, adapter), &devId) || devId < 0) {
+          return error;
+        }
+        // the same adapter twice would only inquire against itself
+        if (std::find(options->adapters.begin(), options->adapters.end(), devId) == options->adapters.end()) {
+          options->adapters.push_back(devId);
+        }
+      }
+    } else {
+      return error;
+    }
+    if (options->hciSocket >= 0) {
+      return "Options hciSocket and adapters do not go together.";
+    }
+  }
+  return NULL;
+}
+
+NAN_METHOD(DeviceINQ::InquireSync) {
+    const char *usage = "usage: inquireSync(found, callback[, options])";
+    if (info.Length() != 2 && info.Length() != 3) {
+        return Nan::ThrowError(usage);
+    }
+
+    inquiry_options_t options;
+    initInquiryOptions(&options);
+    if (info.Length() == 3 && info[2]->IsObject()) {
+        const char *error = parseInquiryOptions(info[2].As<Object>(), &options);
+        if (error != NULL) {
+            return Nan::ThrowTypeError(error);
+        }
+    }
+
+    std::vector<inquiry_result_t> results;
+    if (doInquire(options, [&results](const inquiry_result_t &result) { results.push_back(result); }) < 0) {
+        return Nan::ThrowError("opening socket");
+    }
+
+    Nan::AsyncResource resource("bluetooth-serial-port:InquireSync");
+    Nan::Callback found(info[0].As<Function>());
+    Nan::Callback callback(info[1].As<Function>());
+
+    for (size_t i = 0; i < results.size(); i++) {
+      Local<Value> argv[] = {
+        Nan::New(results[i].device.address).ToLocalChecked(),
+        Nan::New(results[i].device.name).ToLocalChecked(),
+        results[i].hasEir ? Local<Value>(eirToObject(results[i].eir)) : Local<Value>(Nan::Undefined()),
+        resultToObject(results[i])
+      };
+      found.Call(4, argv, &resource);
+    }
+
+    Local<Value> argv[] = {};
+    callback.Call(0, argv, &resource);
+}
+
+// Reports every device on the event loop as soon as its name is in,
+// rather than all of them at the end of the inquiry
+class InquireWorker : public Nan::AsyncProgressQueueWorker<inquiry_result_t> {
+ public:
+  InquireWorker(DeviceINQ *inquire, Nan::Callback* found, Nan::Callback *callback, const inquiry_options_t &options)
+    : Nan::AsyncProgressQueueWorker<inquiry_result_t>(callback), inquire(inquire), found(found), options(options),
+      operation(0), cancelled(false) {
+    control.fd = -1;
+  }
+  ~InquireWorker() {
+    BluetoothHelpers::CloseControl(&control);
+    delete found;
+  }
+
+  // Registers the inquiry with its object, returns the id to cancel it by
+  // or -1 when the control channel cannot be created
+  int Open() {
+    if (BluetoothHelpers::OpenControl(&control) < 0) {
+      return -1;
+    }
+    operation = inquire->StartOperation(&control);
+    return operation;
+  }
+
+  // Executed inside the worker-thread.
+  // It is not safe to access V8, or V8 data structures
+  // here, so everything we need for input and output
+  // should go on `this`.
+  void Execute (const ExecutionProgress& progress) {
+    int result = DeviceINQ::doInquire(options, [&progress](const inquiry_result_t &result) {
+      progress.Send(&result, 1);
+    }, &control);
+    if (result < 0) {
+      if (errno == ECANCELED) {
+        cancelled = true;
+      } else {
+        SetErrorMessage("opening socket");
+      }
+    }
+  }
+
+  // Executed on the event loop for every device that was sent
+  void HandleProgressCallback (const inquiry_result_t *results, size_t count) {
+    Nan::HandleScope scope;
+
+    Nan::AsyncResource resource("bluetooth-serial-port:Inquire");
+    for (size_t i = 0; i < count; i++) {
+      Local<Value> argv[] = {
+        Nan::New(results[i].device.address).ToLocalChecked(),
+        Nan::New(results[i].device.name).ToLocalChecked(),
+        results[i].hasEir ? Local<Value>(eirToObject(results[i].eir)) : Local<Value>(Nan::Undefined()),
+        resultToObject(results[i])
+      };
+      found->Call(4, argv, &resource);
+    }
+  }
+
+  // Executed when the async work is complete, after the last device
+  // this function will be run inside the main event loop
+  // so it is safe to use V8 again
+  void HandleOKCallback () {
+    Nan::HandleScope scope;
+
+    inquire->EndOperation(operation);
+    Nan::AsyncResource resource("bluetooth-serial-port:Inquire");
+    Local<Value> argv[] = {
+      Nan::Null(),
+      Nan::New(cancelled)
+    };
+    callback->Call(2, argv, &resource);
+  }
+
+  void HandleErrorCallback () {
+    Nan::HandleScope scope;
+
+    inquire->EndOperation(operation);
+    Nan::AsyncResource resource("bluetooth-serial-port:Inquire");
+    Local<Value> argv[] = {
+      Nan::Error(ErrorMessage())
+    };
+    callback->Call(1, argv, &resource);
+  }
+
+  private:
+    DeviceINQ *inquire;
+    Nan::Callback* found;
+    inquiry_options_t options;
+    control_channel_t control;
+    int operation;
+    bool cancelled;
+};
+
+// Asynchronous access to the `Inquire()` function
+NAN_METHOD(DeviceINQ::Inquire) {
+  const char *usage = "usage: inquire(found, callback[, options])";
+  if (info.Length() != 2 && info.Length() != 3) {
+      return Nan::ThrowError(usage);
+  }
+
+  inquiry_options_t options;
+  initInquiryOptions(&options);
+  if (info.Length() == 3 && info[2]->IsObject()) {
+    const char *error = parseInquiryOptions(info[2].As<Object>(), &options);
+    if (error != NULL) {
+      return Nan::ThrowTypeError(error);
+    }
+  }
+
+  Nan::Callback *found = new Nan::Callback(info[0].As<Function>());
+  Nan::Callback *callback = new Nan::Callback(info[1].As<Function>());
+
+  DeviceINQ *inquire = Nan::ObjectWrap::Unwrap<DeviceINQ>(info.This());
+  InquireWorker *worker = new InquireWorker(inquire, found, callback, options);
+  int operation = worker->Open();
+  if (operation < 0) {
+    delete worker;
+    return Nan::ThrowError("Cannot create the control channel.");
+  }
+  worker->SaveToPersistent("inquire", info.This());
+
+  Nan::AsyncQueueWorker(worker);
+  info.GetReturnValue().Set(operation);
+}
+
+// How a continuous discovery runs on top of the inquiries it repeats
+struct discovery_options_t {
+  inquiry_options_t inquiry;
+  int interval;     // ms between the end of one inquiry and the start of the next
+  int rssiDelta;    // dB the RSSI moves before a device is reported changed
+  int lostAfter;    // ms without an answer before a device is reported lost
+};
+
+#define DISCOVERY_DEFAULT_LENGTH 4
+#define DISCOVERY_DEFAULT_RSSI_DELTA 6
+// names are read once per device and taken from the device cache after that
+#define DISCOVERY_DEFAULT_CACHE_TTL 3600000
+
+// What a continuous discovery tells JS
+#define DISCOVERY_FOUND 0
+#define DISCOVERY_CHANGED 1
+#define DISCOVERY_LOST 2
+
+struct discovery_event_t {
+  int kind;
+  inquiry_result_t result;
+};
+
+// A device a continuous discovery keeps track of
+struct tracked_device_t {
+  inquiry_result_t reported;    // as JS last heard of it
+  uint64_t seen;                // uv_hrtime() of the last inquiry it answered
+};
+
+// Repeats inquiries over one socket until stopped and reports only what
+// changed between them: devices that showed up, that moved by rssiDelta or
+// changed their name, and that did not answer for lostAfter
+class DiscoveryWorker : public Nan::AsyncProgressQueueWorker<discovery_event_t> {
+ public:
+  DiscoveryWorker(DeviceINQ *inquire, Nan::Callback *event, Nan::Callback *callback, const discovery_options_t &options)
+    : Nan::AsyncProgressQueueWorker<discovery_event_t>(callback), inquire(inquire), event(event), options(options) {
+    control.fd = -1;
+    control.commands = 0;
+  }
+  ~DiscoveryWorker() {
+    delete event;
+    BluetoothHelpers::CloseControl(&control);
+  }
+
+  int Open() {
+    return BluetoothHelpers::OpenControl(&control);
+  }
+
+  // Called on the event loop, the inquiry running at the time is cancelled
+  void Stop() {
+    BluetoothHelpers::SignalControl(&control, CONTROL_CLOSE);
+  }
+
+  void Execute (const ExecutionProgress& progress) {
+    int devId;
+    int sock = openInquirySocket(options.inquiry, options.inquiry.adapters.empty() ? -1 : options.inquiry.adapters[0], &devId);
+    if (sock < 0) {
+      SetErrorMessage("opening socket");
+      return;
+    }
+
+    std::map<std::string, tracked_device_t> tracked;
+    bool stopped = false;
+    while (!stopped) {
+      std::vector<inquiry_result_t> answered;
+      if (!options.inquiry.cacheFile.empty()) {
+        BluetoothHelpers::LoadDeviceCache(options.inquiry.cacheFile);
+      }
+      if (runInquiry(sock, devId, NULL, options.inquiry, &control, NULL, [&answered](const inquiry_result_t &result) { answered.push_back(result); }) < 0) {
+        if (errno != ECANCELED) {
+          SetErrorMessage("inquiry failed");
+        }
+        break;
+      }
+      if (!options.inquiry.cacheFile.empty()) {
+        BluetoothHelpers::SaveDeviceCache(options.inquiry.cacheFile);
+      }
+
+      uint64_t now = uv_hrtime();
+      for (size_t i = 0; i < answered.size(); i++) {
+        discovery_event_t message;
+        message.result = answered[i];
+
+        std::map<std::string, tracked_device_t>::iterator found = tracked.find(answered[i].device.address);
+        if (found == tracked.end()) {
+          tracked_device_t device = { answered[i], now };
+          tracked[answered[i].device.address] = device;
+          message.kind = DISCOVERY_FOUND;
+          progress.Send(&message, 1);
+          continue;
+        }
+
+        found->second.seen = now;
+        const inquiry_result_t &reported = found->second.reported;
+        bool moved = answered[i].rssi != INQUIRY_NO_RSSI && (reported.rssi == INQUIRY_NO_RSSI ||
+            abs(answered[i].rssi - reported.rssi) >= options.rssiDelta);
+        if (moved || strcmp(answered[i].device.name, reported.device.name) != 0) {
+          found->second.reported = answered[i];
+          message.kind = DISCOVERY_CHANGED;
+          progress.Send(&message, 1);
+        }
+      }
+
+      for (std::map<std::string, tracked_device_t>::iterator it = tracked.begin(); it != tracked.end();) {
+        if (now - it->second.seen < (uint64_t) options.lostAfter * 1000000) {
+          ++it;
+          continue;
+        }
+        discovery_event_t message;
+        message.kind = DISCOVERY_LOST;
+        message.result = it->second.reported;
+        progress.Send(&message, 1);
+        tracked.erase(it++);
+      }
+
+      // a stop while waiting ends it here, one during the next inquiry cancels that
+      if (options.interval > 0) {
+        struct pollfd p;
+        p.fd = control.fd;
+        p.events = POLLIN;
+        p.revents = 0;
+        if (poll(&p, 1, options.interval) > 0 && (BluetoothHelpers::TakeControl(&control) & CONTROL_CLOSE)) {
+          stopped = true;
+        }
+      }
+    }
+
+    closeInquirySocket(options.inquiry, sock);
+  }
+
+  void HandleProgressCallback (const discovery_event_t *messages, size_t count) {
+    Nan::HandleScope scope;
+
+    static const char *names[] = { "deviceFound", "deviceChanged", "deviceLost" };
+    Nan::AsyncResource resource("bluetooth-serial-port:Discover");
+    for (size_t i = 0; i < count; i++) {
+      Local<Value> argv[] = {
+        Nan::New(names[messages[i].kind]).ToLocalChecked(),
+        resultToObject(messages[i].result)
+      };
+      event->Call(2, argv, &resource);
+    }
+  }
+
+  void HandleOKCallback () {
+    Nan::HandleScope scope;
+
+    inquire->discovery = NULL;
+    Nan::AsyncResource resource("bluetooth-serial-port:Discover");
+    Local<Value> argv[] = {};
+    callback->Call(0, argv, &resource);
+  }
+
+  void HandleErrorCallback () {
+    Nan::HandleScope scope;
+
+    inquire->discovery = NULL;
+    Nan::AsyncResource resource("bluetooth-serial-port:Discover");
+    Local<Value> argv[] = {
+      Nan::Error(ErrorMessage())
+    };
+    callback->Call(1, argv, &resource);
+  }
+
+  private:
+    DeviceINQ *inquire;
+    Nan::Callback *event;
+    discovery_options_t options;
+    control_channel_t control;
+};
+
+NAN_METHOD(DeviceINQ::Discover) {
+  const char *usage = "usage: discover(event, callback[, options])";
+  if (info.Length() != 2 && info.Length() != 3) {
+    return Nan::ThrowError(usage);
+  }
+  if (!info[0]->IsFunction() || !info[1]->IsFunction()) {
+    return Nan::ThrowTypeError("First and second argument should be functions.");
+  }
+
+  DeviceINQ *inquire = Nan::ObjectWrap::Unwrap<DeviceINQ>(info.This());
+  if (inquire->discovery != NULL) {
+    return Nan::ThrowError("Discovery is already running.");
+  }
+
+  discovery_options_t options;
+  initInquiryOptions(&options.inquiry);
+  options.inquiry.length = DISCOVERY_DEFAULT_LENGTH;
+  options.inquiry.cacheTtl = DISCOVERY_DEFAULT_CACHE_TTL;
+  options.interval = 0;
+  options.rssiDelta = DISCOVERY_DEFAULT_RSSI_DELTA;
+  options.lostAfter = -1;
+
+  if (info.Length() == 3 && info[2]->IsObject()) {
+    Local<Object> jsOptions = info[2].As<Object>();
+    const char *error = parseInquiryOptions(jsOptions, &options.inquiry);
+    if (error != NULL) {
+      return Nan::ThrowTypeError(error);
+    }
+
+    Local<Context> ctx = Nan::GetCurrentContext();
+    Local<Value> interval = Nan::Get(jsOptions, Nan::New("interval").ToLocalChecked()).ToLocalChecked();
+    Local<Value> rssiDelta = Nan::Get(jsOptions, Nan::New("rssiDelta").ToLocalChecked()).ToLocalChecked();
+    Local<Value> lostAfter = Nan::Get(jsOptions, Nan::New("lostAfter").ToLocalChecked()).ToLocalChecked();
+
+    if (!interval->IsUndefined()) {
+      options.interval = interval->Int32Value(ctx).FromMaybe(-1);
+      if (options.interval < 0) {
+        return Nan::ThrowTypeError("Option interval should be a positive int value.");
+      }
+    }
+    if (!rssiDelta->IsUndefined()) {
+      options.rssiDelta = rssiDelta->Int32Value(ctx).FromMaybe(0);
+      if (options.rssiDelta <= 0) {
+        return Nan::ThrowTypeError("Option rssiDelta should be a positive int value.");
+      }
+    }
+    if (!lostAfter->IsUndefined()) {
+      options.lostAfter = lostAfter->Int32Value(ctx).FromMaybe(0);
+      if (options.lostAfter <= 0) {
+        return Nan::ThrowTypeError("Option lostAfter should be a positive int value.");
+      }
+    }
+  }
+
+  // a discovery repeats its inquiries over a single socket
+  if (options.inquiry.allAdapters || options.inquiry.adapters.size() > 1) {
+    return Nan::ThrowTypeError("Option adapters takes a single adapter for a discovery.");
+  }
+
+  // by default a device is lost when it missed three inquiries in a row
+  if (options.lostAfter < 0) {
+    options.lostAfter = 3 * (options.inquiry.length * 1280 + options.interval);
+  }
+
+  DiscoveryWorker *worker = new DiscoveryWorker(inquire, new Nan::Callback(info[0].As<Function>()),
+      new Nan::Callback(info[1].As<Function>()), options);
+  if (worker->Open() < 0) {
+    delete worker;
+    return Nan::ThrowError("Cannot create the control channel.");
+  }
+  worker->SaveToPersistent("inquire", info.This());
+  inquire->discovery = worker;
+
+  Nan::AsyncQueueWorker(worker);
+}
+
+NAN_METHOD(DeviceINQ::StopDiscovery) {
+  DeviceINQ *inquire = Nan::ObjectWrap::Unwrap<DeviceINQ>(info.This());
+  if (inquire->discovery != NULL) {
+    inquire->discovery->Stop();
+  }
+}
+
+NAN_METHOD(DeviceINQ::SdpSearch) {
+    const char *usage = "usage: findSerialPortChannel(address, callback)";
+    if (info.Length() != 2) {
+        return Nan::ThrowError(usage);
+    }
+
+    if (!info[0]->IsString()) {
+        return Nan::ThrowTypeError("First argument should be a string value");
+    }
+    String::Utf8Value address(info.GetIsolate(), info[0]);
+
+    if(!info[1]->IsFunction()) {
+        return Nan::ThrowTypeError("Second argument must be a function");
+    }
+
+    Local<Function> cb = info[1].As<Function>();
+
+    DeviceINQ* inquire = Nan::ObjectWrap::Unwrap<DeviceINQ>(info.This());
+
+    control_channel_t *control = new control_channel_t();
+    if (BluetoothHelpers::OpenControl(control) < 0) {
+        delete control;
+        return Nan::ThrowError("Cannot create the control channel.");
+    }
+
+    sdp_baton_t *baton = new sdp_baton_t();
+    baton->inquire = inquire;
+    baton->cb = new Nan::Callback(cb);
+    strncpy(baton->address, *address, sizeof(baton->address) - 1);
+    baton->channelID = -1;
+    baton->control = control;
+    baton->operation = inquire->StartOperation(control);
+    baton->cancelled = false;
+    baton->request.data = baton;
+    baton->inquire->Ref();
+
+    uv_queue_work(uv_default_loop(), &baton->request, EIO_SdpSearch, (uv_after_work_cb)EIO_AfterSdpSearch);
+
+    info.GetReturnValue().Set(baton->operation);
+}
+
+// Cancels an inquiry or a search by the id it returned. The operation
+// completes as cancelled, an id that already completed is ignored.
+NAN_METHOD(DeviceINQ::Cancel) {
+    const char *usage = "usage: cancel(id)";
+    if (info.Length() != 1 || !info[0]->IsNumber()) {
+        return Nan::ThrowError(usage);
+    }
+
+    DeviceINQ *inquire = Nan::ObjectWrap::Unwrap<DeviceINQ>(info.This());
+    int id = info[0]->Int32Value(Nan::GetCurrentContext()).FromMaybe(0);
+    std::map<int, control_channel_t *>::iterator it = inquire->operations.find(id);
+    if (it != inquire->operations.end()) {
+        BluetoothHelpers::SignalControl(it->second, CONTROL_CLOSE);
+    }
+}
+
+// How a full service search is answered from and kept in the service cache
+struct service_options_t {
+    int cacheTtl;           // ms the records of a search answer later ones, 0 to always search
+    std::string cacheFile;  // where the service cache is kept between runs, empty for nowhere
+};
+
+static Local<Array> servicesToArray(const std::vector<service_record_t> &records) {
+  Local<Array> services = Nan::New<Array>((int) records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    Nan::Set(services, i, serviceToObject(records[i]));
+  }
+  return services;
+}
+
+// Reads all service records of a device, from the service cache when a
+// search was recent enough, otherwise from the device itself. The records
+// of a search go into the cache as the device sent them and are parsed
+// again for every lookup, so the cache file holds no format of our own.
+class ServiceWorker : public Nan::AsyncWorker {
+ public:
+  ServiceWorker(DeviceINQ *inquire, Nan::Callback *callback, const char *address, const service_options_t &options)
+    : Nan::AsyncWorker(callback), inquire(inquire), address(address), options(options),
+      operation(0), cancelled(false), cached(false) {
+    control.fd = -1;
+  }
+  ~ServiceWorker() {
+    BluetoothHelpers::CloseControl(&control);
+  }
+
+  // Registers the search with its object, returns the id to cancel it by
+  // or -1 when the control channel cannot be created
+  int Open() {
+    if (BluetoothHelpers::OpenControl(&control) < 0) {
+      return -1;
+    }
+    operation = inquire->StartOperation(&control);
+    return operation;
+  }
+
+  void Execute () {
+    if (!options.cacheFile.empty()) {
+      BluetoothHelpers::LoadServiceCache(options.cacheFile);
+    }
+
+    service_cache_entry_t entry;
+    str2ba(address.c_str(), (bdaddr_t *) entry.bdaddr);
+    cached = options.cacheTtl > 0 && BluetoothHelpers::LookupServices(entry.bdaddr, &entry) &&
+        wallClock() - entry.searched <= (uint64_t) options.cacheTtl;
+
+    if (!cached) {
+      // every record runs over L2CAP, so searching for it finds them all,
+      // also those left out of the public browse group
+      if (searchServices(address.c_str(), L2CAP_UUID, &control, &entry.records, &cancelled) < 0) {
+        if (!cancelled) {
+          SetErrorMessage("Cannot search the services of the device.");
+        }
+        return;
+      }
+      entry.searched = wallClock();
+      BluetoothHelpers::StoreServices(entry);
+      if (!options.cacheFile.empty()) {
+        BluetoothHelpers::SaveServiceCache(options.cacheFile);
+      }
+    }
+
+    if (!entry.records.empty()) {
+      DeviceINQ::parseServiceRecords(&entry.records[0], entry.records.size(), &records);
+    }
+  }
+
+  void HandleOKCallback () {
+    Nan::HandleScope scope;
+
+    inquire->EndOperation(operation);
+    Nan::AsyncResource resource("bluetooth-serial-port:DiscoverServices");
+    if (cancelled) {
+      Local<Object> err = Nan::Error("The search was cancelled.").As<Object>();
+      Nan::Set(err, Nan::New("code").ToLocalChecked(), Nan::New("ECANCELED").ToLocalChecked());
+      Local<Value> argv[] = {
+        err
+      };
+      callback->Call(1, argv, &resource);
+      return;
+    }
+
+    Local<Value> argv[] = {
+      Nan::Null(),
+      servicesToArray(records),
+      Nan::New(cached)
+    };
+    callback->Call(3, argv, &resource);
+  }
+
+  void HandleErrorCallback () {
+    Nan::HandleScope scope;
+
+    inquire->EndOperation(operation);
+    Nan::AsyncResource resource("bluetooth-serial-port:DiscoverServices");
+    Local<Value> argv[] = {
+      Nan::Error(ErrorMessage())
+    };
+    callback->Call(1, argv, &resource);
+  }
+
+  private:
+    DeviceINQ *inquire;
+    std::string address;
+    service_options_t options;
+    control_channel_t control;
+    int operation;
+    bool cancelled;
+    bool cached;
+    std::vector<service_record_t> records;
+};
+
+NAN_METHOD(DeviceINQ::DiscoverServices) {
+  const char *usage = "usage: discoverServices(address, callback[, options])";
+  if (info.Length() != 2 && info.Length() != 3) {
+    return Nan::ThrowError(usage);
+  }
+  if (!info[0]->IsString()) {
+    return Nan::ThrowTypeError("First argument should be a string value");
+  }
+  if (!info[1]->IsFunction()) {
+    return Nan::ThrowTypeError("Second argument must be a function");
+  }
+
+  Isolate *isolate = info.GetIsolate();
+  String::Utf8Value address(isolate, info[0]);
+  if (bachk(*address) < 0) {
+    return Nan::ThrowTypeError("First argument should be a bluetooth address.");
+  }
+
+  service_options_t options;
+  options.cacheTtl = SERVICE_DEFAULT_CACHE_TTL;
+  if (info.Length() == 3 && info[2]->IsObject()) {
+    Local<Object> jsOptions = info[2].As<Object>();
+    Local<Context> ctx = Nan::GetCurrentContext();
+    Local<Value> cacheTtl = Nan::Get(jsOptions, Nan::New("cacheTtl").ToLocalChecked()).ToLocalChecked();
+    Local<Value> cacheFile = Nan::Get(jsOptions, Nan::New("cacheFile").ToLocalChecked()).ToLocalChecked();
+
+    if (!cacheTtl->IsUndefined()) {
+      options.cacheTtl = cacheTtl->Int32Value(ctx).FromMaybe(-1);
+      if (options.cacheTtl < 0) {
+        return Nan::ThrowTypeError("Option cacheTtl should be a positive int value.");
+      }
+    }
+    if (!cacheFile->IsUndefined()) {
+      if (!cacheFile->IsString()) {
+        return Nan::ThrowTypeError("Option cacheFile should be a string value.");
+      }
+      options.cacheFile = *String::Utf8Value(isolate, cacheFile);
+    }
+  }
+
+  DeviceINQ *inquire = Nan::ObjectWrap::Unwrap<DeviceINQ>(info.This());
+  ServiceWorker *worker = new ServiceWorker(inquire, new Nan::Callback(info[1].As<Function>()), *address, options);
+  int operation = worker->Open();
+  if (operation < 0) {
+    delete worker;
+    return Nan::ThrowError("Cannot create the control channel.");
+  }
+  worker->SaveToPersistent("inquire", info.This());
+
+  Nan::AsyncQueueWorker(worker);
+  info.GetReturnValue().Set(operation);
+}
+
+NAN_METHOD(DeviceINQ::ListPairedDevices) {
+    const char *usage = "usage: listPairedDevices(callback[, options])";
+    if (info.Length() != 1 && info.Length() != 2) {
+        return Nan::ThrowError(usage);
+    }
+
+    if(!info[0]->IsFunction()) {
+       return Nan::ThrowTypeError("First argument must be a function");
+    }
+    Local<Function> cb = info[0].As<Function>();
+
+    std::string root = BLUEZ_STORAGE_DIR;
+    if (info.Length() == 2 && info[1]->IsObject()) {
+        Local<Object> jsOptions = info[1].As<Object>();
+        Isolate *isolate = jsOptions->GetIsolate();
+        Local<Value> storageDir = Nan::Get(jsOptions, Nan::New("storageDir").ToLocalChecked()).ToLocalChecked();
+        if (!storageDir->IsUndefined()) {
+            if (!storageDir->IsString()) {
+                return Nan::ThrowTypeError("Option storageDir should be a string value.");
+            }
+            root = *String::Utf8Value(isolate, storageDir);
+        }
+    }
+
+    // the store is a few small files per device, read right here like the
+    // other platforms answer from their own paired device lists
+    std::vector<paired_device_t> devices;
+    readPairedDevices(root, &devices);
+
+    Local<Array> resultArray = Local<Array>(Nan::New<Array>((int) devices.size()));
+    for (size_t i = 0; i < devices.size(); i++) {
+        const paired_device_t &device = devices[i];
+        Local<Object> deviceObj = Nan::New<Object>();
+
+        Nan::Set(deviceObj, Nan::New("name").ToLocalChecked(), Nan::New(device.name).ToLocalChecked());
+        Nan::Set(deviceObj, Nan::New("address").ToLocalChecked(), Nan::New(device.address).ToLocalChecked());
+        Nan::Set(deviceObj, Nan::New("adapter").ToLocalChecked(), Nan::New(device.adapter).ToLocalChecked());
+        if (device.deviceClass >= 0) {
+            Nan::Set(deviceObj, Nan::New("deviceClass").ToLocalChecked(), Nan::New(device.deviceClass));
+        }
+
+        Local<Array> uuids = Nan::New<Array>((int) device.uuids.size());
+        for (size_t j = 0; j < device.uuids.size(); j++) {
+            Nan::Set(uuids, j, Nan::New(device.uuids[j]).ToLocalChecked());
+        }
+        Nan::Set(deviceObj, Nan::New("uuids").ToLocalChecked(), uuids);
+
+        Local<Array> servicesArray = Nan::New<Array>((int) device.services.size());
+        for (size_t j = 0; j < device.services.size(); j++) {
+            Nan::Set(servicesArray, j, serviceToObject(device.services[j]));
+        }
+        Nan::Set(deviceObj, Nan::New("services").ToLocalChecked(), servicesArray);
+
+        Nan::Set(resultArray, i, deviceObj);
+    }
+
+    Local<Value> argv[1] = {
         resultArray
     };
     cb->Call(Nan::GetCurrentContext(), Nan::GetCurrentContext()->Global(), 1, argv);
 
     return;
 }
+
+NAN_METHOD(DeviceINQ::ParseEir) {
+    const char *usage = "usage: DeviceINQ.parseEir(buffer)";
+    if (info.Length() != 1) {
+        return Nan::ThrowError(usage);
+    }
+
+    if (!node::Buffer::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("Argument should be a buffer.");
+    }
+
+    Local<Object> buffer = info[0].As<Object>();
+    eir_data_t eir;
+    DeviceINQ::parseEir((const uint8_t *) node::Buffer::Data(buffer), node::Buffer::Length(buffer), &eir);
+
+    info.GetReturnValue().Set(eirToObject(eir));
+}
+
+NAN_METHOD(DeviceINQ::ParseServiceRecords) {
+    const char *usage = "usage: DeviceINQ.parseServiceRecords(buffer)";
+    if (info.Length() != 1) {
+        return Nan::ThrowError(usage);
+    }
+
+    if (!node::Buffer::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("Argument should be a buffer.");
+    }
+
+    Local<Object> buffer = info[0].As<Object>();
+    std::vector<service_record_t> records;
+    if (DeviceINQ::parseServiceRecords((const uint8_t *) node::Buffer::Data(buffer), node::Buffer::Length(buffer), &records) < 0) {
+        return Nan::ThrowTypeError("Buffer should hold a data element sequence of service records.");
+    }
+
+    info.GetReturnValue().Set(servicesToArray(records));
+}
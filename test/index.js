@@ -4,13 +4,19 @@ var Bt = new bt.BluetoothSerialPort();
 console.log('Checking client...');
 
 [
-    'inquire', 'findSerialPortChannel', 'connect', 'write', 'on', 'close'
+    'inquire', 'findSerialPortChannel', 'connect', 'write', 'on', 'close',
+    'getSocketInfo', 'detach', 'startDiscovery', 'stopDiscovery',
+    'discoverServices'
 ].forEach(function(fun) {
     if (typeof Bt[fun] !== 'function')
         throw new Error("Assert failed: " + fun +
                         "should be a function but is " + (typeof Bt[fun]));
 });
 
+if (typeof bt.BluetoothSerialPort.fromFd !== 'function')
+    throw new Error("Assert failed: fromFd should be a function but is " +
+                    (typeof bt.BluetoothSerialPort.fromFd));
+
 console.log('Ok!');
 
 if (process.platform === 'linux') {
@@ -18,7 +24,8 @@ if (process.platform === 'linux') {
 
     var ServerBt = new bt.BluetoothSerialPortServer();
     [
-        'listen', 'write', 'on', 'close'
+        'listen', 'write', 'on', 'close', 'getSocketInfo', 'detachClient',
+        'broadcast', 'getStats'
     ].forEach(function(fun) {
         if (typeof ServerBt[fun] !== 'function')
             throw new Error("Assert failed: " + fun +